@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdarg.h>
 
 #define VGA_WIDTH 80
 #define VGA_HEIGHT 25
@@ -36,6 +37,23 @@ static inline uint16_t vga_entry(unsigned char uc, uint8_t color) {
 }
 
 size_t strlen(const char* str);
+size_t strlcpy(char* dst, const char* src, size_t size);
+int strcmp(const char* a, const char* b);
+void* memcpy(void* dst, const void* src, size_t n);
+void* memmove(void* dst, const void* src, size_t n);
+void* memset(void* dst, int c, size_t n);
+void memsetw(uint16_t* dst, uint16_t value, size_t count);
+void memsetl(uint32_t* dst, uint32_t value, size_t count);
+int memcmp(const void* a, const void* b, size_t n);
+void string_initialize(void);
+const char* string_impl(void);
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* eax,
+                         uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile ( "cpuid"
+                   : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                   : "a"(leaf), "c"(subleaf) );
+}
 
 static inline void outb(uint16_t port, uint8_t val) {
     asm volatile ( "outb %0, %1" : : "a"(val), "dN"(port) );
@@ -47,10 +65,141 @@ static inline uint8_t inb(uint16_t port) {
     return ret;
 }
 
+static inline void outw(uint16_t port, uint16_t val) {
+    asm volatile ( "outw %0, %1" : : "a"(val), "dN"(port) );
+}
+
+static inline uint16_t inw(uint16_t port) {
+    uint16_t ret;
+    asm volatile ( "inw %1, %0" : "=a"(ret) : "dN"(port) );
+    return ret;
+}
+
+static inline void outl(uint16_t port, uint32_t val) {
+    asm volatile ( "outl %0, %1" : : "a"(val), "dN"(port) );
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    asm volatile ( "inl %1, %0" : "=a"(ret) : "dN"(port) );
+    return ret;
+}
+
+static inline void mb(void) {
+    asm volatile ( "lock; addl $0, 0(%%esp)" : : : "memory" );
+}
+
+static inline uint32_t div64_u32(uint64_t* n, uint32_t base) {
+    uint32_t high = (uint32_t)(*n >> 32);
+    uint32_t low = (uint32_t)*n;
+    uint32_t q_high = high / base;
+    uint32_t q_low, rem;
+    high %= base;
+    asm ( "divl %4" : "=a"(q_low), "=d"(rem) : "a"(low), "d"(high), "rm"(base) );
+    *n = ((uint64_t)q_high << 32) | q_low;
+    return rem;
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t low, high;
+    asm volatile ( "rdmsr" : "=a"(low), "=d"(high) : "c"(msr) );
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile ( "wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)) );
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile ( "rdtsc" : "=a"(low), "=d"(high) );
+    return ((uint64_t)high << 32) | low;
+}
+
+#define EFLAGS_IF 0x200
+
+void irqsoff_begin(void* ip);
+void irqsoff_end(void* ip);
+void irqsoff_initialize(void);
+void cmd_irqsoff(const char* args);
+
+/* Always inlined so the recorded address is the call site itself. */
+#define IRQSOFF_SITE(ip) asm volatile ( "movl $., %0" : "=r"(ip) )
+
+static inline __attribute__((always_inline)) uint32_t local_irq_save(void) {
+    uint32_t flags;
+    asm volatile ( "pushf; pop %0; cli" : "=r"(flags) : : "memory" );
+    if (flags & EFLAGS_IF) {
+        void* ip;
+        IRQSOFF_SITE(ip);
+        irqsoff_begin(ip);
+    }
+    return flags;
+}
+
+static inline __attribute__((always_inline)) void local_irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) {
+        void* ip;
+        IRQSOFF_SITE(ip);
+        irqsoff_end(ip);
+    }
+    asm volatile ( "push %0; popf" : : "r"(flags) : "memory", "cc" );
+}
+
+static inline __attribute__((always_inline)) void local_irq_disable(void) {
+    uint32_t flags;
+    asm volatile ( "pushf; pop %0; cli" : "=r"(flags) : : "memory" );
+    if (flags & EFLAGS_IF) {
+        void* ip;
+        IRQSOFF_SITE(ip);
+        irqsoff_begin(ip);
+    }
+}
+
+static inline __attribute__((always_inline)) void local_irq_enable(void) {
+    void* ip;
+    IRQSOFF_SITE(ip);
+    irqsoff_end(ip);
+    asm volatile ( "sti" : : : "memory" );
+}
+
+/* sti only takes effect after the next instruction, so no interrupt can
+   slip in between the caller's last check and the hlt. */
+static inline __attribute__((always_inline)) void safe_halt(void) {
+    void* ip;
+    IRQSOFF_SITE(ip);
+    irqsoff_end(ip);
+    asm volatile ( "sti; hlt" : : : "memory" );
+}
+
+typedef struct console_backend {
+    const char* name;
+    size_t width;
+    size_t height;
+    void (*putentryat)(char c, uint8_t color, size_t x, size_t y);
+    void (*scroll)(uint8_t color);
+    void (*clear)(uint8_t color);
+    void (*flush)(void);
+} console_backend_t;
+
 void terminal_initialize(void);
 void terminal_setcolor(uint8_t color);
 void terminal_writestring(const char* data);
+void terminal_write(const char* data, size_t size);
 void terminal_putchar(char c);
+void terminal_set_backend(console_backend_t* backend);
+const char* terminal_backend_name(void);
+size_t terminal_width(void);
+size_t terminal_height(void);
+
+struct multiboot_info;
+struct multiboot_info* get_boot_info(void);
+int memory_range_free(uint32_t start, uint32_t len);
+
+int kprintf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+int kvprintf(const char* fmt, va_list ap);
+int ksnprintf(char* buf, size_t size, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+int kvsnprintf(char* buf, size_t size, const char* fmt, va_list ap);
 
 void* kmalloc(size_t size);
 void kfree(void* ptr);
@@ -75,8 +224,11 @@ int register_extension(const char* name, const char* version,
                        int (*init_func)(void), void (*cleanup_func)(void));
 int load_extension(int ext_id);
 int unload_extension(int ext_id);
+int unregister_extension(int ext_id);
+int get_extension_count(void);
 int register_command(const char* name, void (*handler)(const char*),
                      const char* description, int ext_id);
+int unregister_commands(int ext_id);
 command_t* find_command(const char* name);
 void process_command(const char* input);
 
@@ -87,12 +239,248 @@ extern extension_auto_register_func_t __ext_register_end[];
 
 void initialize_all_extensions(void);
 
+int module_load(const char* name, const void* data, size_t size);
+int module_unload(const char* name);
+void module_load_boot_modules(void);
+void cmd_lsmod(const char* args);
+void cmd_rmmod(const char* args);
+
 extern void generic_isr_handler(int int_no);
 extern void keyboard_handler_c(void);
 extern void timer_handler_c(void);
 
+int register_timer_callback(void (*callback)(void), uint32_t interval_ticks);
+int unregister_timer_callback(void (*callback)(void));
+uint64_t timer_get_ticks(void);
+
 extern char read_char_from_kb_buffer();
+int kb_buffer_pending(void);
 extern char wait_for_char_from_kb_buffer();
 
+extern uint32_t irq_stub_table[16];
+int register_irq_handler(uint8_t irq, void (*handler)(void));
+int unregister_irq_handler(uint8_t irq, void (*handler)(void));
+void irq_dispatch_c(int int_no);
+void set_idt_gate(uint8_t num, uint32_t base, uint8_t flags);
+
+typedef int (*syscall_fn_t)(int a1, int a2, int a3);
+
+int register_syscall(int num, syscall_fn_t fn);
+int unregister_syscall(int num, syscall_fn_t fn);
+int syscall_dispatch(int num, int a1, int a2, int a3);
+int run_user_program(void (*entry)(void));
+
+extern char _user_image_start[];
+extern char _user_image_end[];
+extern void user_test_main(void);
+
+typedef struct pci_device {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t irq_line;
+    uint32_t bar[6];
+} pci_device_t;
+
+uint32_t pci_config_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+void pci_config_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t val);
+pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id, int index);
+void pci_enable_bus_master(pci_device_t* dev);
+
+#define BLOCK_SECTOR_SIZE 512
+#define BLOCK_MAX_SEGMENTS 8
+#define MAX_BLOCK_DEVICES 8
+
+#define BLOCK_REQ_NOWAIT 0x01
+
+enum block_status {
+    BLOCK_PENDING = 0,
+    BLOCK_OK = 1,
+    BLOCK_ERROR = 2,
+};
+
+typedef struct block_segment {
+    void* addr;
+    uint32_t len;
+} block_segment_t;
+
+typedef struct block_request {
+    uint64_t sector;
+    int write;
+    int flags;
+    block_segment_t segs[BLOCK_MAX_SEGMENTS];
+    int nsegs;
+    volatile int status;
+    void (*complete)(struct block_request* req);
+    void* private_data;
+} block_request_t;
+
+typedef struct block_device {
+    char name[16];
+    uint64_t sectors;
+    int (*submit)(struct block_device* dev, block_request_t* req);
+    void (*unplug)(struct block_device* dev);
+    void* driver_data;
+    int id;
+} block_device_t;
+
+int register_block_device(block_device_t* dev);
+int unregister_block_device(block_device_t* dev);
+void block_set_invalidate_hook(void (*hook)(block_device_t* dev));
+block_device_t* get_block_device(int id);
+block_device_t* find_block_device(const char* name);
+int block_submit(block_device_t* dev, block_request_t* req);
+void block_unplug(block_device_t* dev);
+int block_rw_start(block_device_t* dev, block_request_t* req, uint64_t sector,
+                   void* buf, uint32_t count, int write);
+int block_rw_sync(block_device_t* dev, uint64_t sector, void* buf,
+                  uint32_t count, int write);
+void cmd_lsblk(const char* args);
+
+#define BCACHE_BLOCK_SIZE 4096
+#define BCACHE_DEFAULT_BUDGET (128 * 1024)
+
+typedef struct bcache_buf {
+    block_device_t* dev;
+    uint32_t block;
+    void* data;
+    volatile uint32_t flags;
+    uint32_t refcount;
+    block_request_t req;
+    struct bcache_buf* hash_next;
+    struct bcache_buf* lru_prev;
+    struct bcache_buf* lru_next;
+} bcache_buf_t;
+
+bcache_buf_t* bcache_read(block_device_t* dev, uint32_t block);
+void bcache_release(bcache_buf_t* buf);
+void bcache_mark_dirty(bcache_buf_t* buf);
+int bcache_sync(void);
+void bcache_set_budget(size_t bytes);
+
+
+#define IPC_PAGE_SIZE 4096
+#define IPC_MAX_CHANNELS 16
+#define IPC_RING_SLOTS 256
+#define IPC_OWNER_CORE -1
+
+#define IPC_MSG_KEY 1
+
+typedef struct ipc_msg {
+    uint32_t type;
+    uint32_t len;
+    void* page;
+    uint32_t arg;
+} ipc_msg_t;
+
+typedef struct ipc_channel {
+    char name[16];
+    ipc_msg_t* ring;
+    volatile uint32_t head;
+    volatile uint32_t committed;
+    volatile uint32_t tail;
+    int owner;
+    void (*notify)(struct ipc_channel* ch);
+    uint32_t sent;
+    uint32_t notifications;
+    uint32_t dropped;
+} ipc_channel_t;
+
+ipc_channel_t* ipc_create(const char* name, int owner);
+ipc_channel_t* ipc_lookup(const char* name);
+void ipc_destroy(ipc_channel_t* ch);
+void ipc_set_receiver(ipc_channel_t* ch, int owner, void (*notify)(ipc_channel_t* ch));
+void* ipc_page_alloc(int owner);
+int ipc_page_free(int owner, void* page);
+int ipc_send(ipc_channel_t* ch, int sender, uint32_t type, void* page, uint32_t len, uint32_t arg);
+void ipc_commit(ipc_channel_t* ch, int sender);
+int ipc_recv(ipc_channel_t* ch, int receiver, ipc_msg_t* out);
+void cmd_ipcstat(const char* args);
+
+#define MAX_TASKS 16
+#define TASK_LOCAL_SIZE 128
+
+enum task_result {
+    TASK_YIELDED = 0,
+    TASK_WAITING = 1,
+    TASK_DONE = 2,
+};
+
+enum task_wait {
+    WAIT_NONE = 0,
+    WAIT_KEY = 1,
+    WAIT_TICKS = 2,
+    WAIT_IO = 3,
+};
+
+/* A stackless coroutine: lc records where to resume, and anything that
+   must survive an await lives in local[] rather than on the stack.
+   Resume points are keyed by __LINE__, so at most one await per line. */
+typedef struct task {
+    int (*fn)(struct task* t);
+    const char* name;
+    uint16_t lc;
+    uint8_t used;
+    uint8_t wait;
+    uint64_t wake_tick;
+    const volatile int* io_status;
+    struct task* prev_fg;
+    void* data;
+    uint32_t local[TASK_LOCAL_SIZE / 4];
+} task_t;
+
+task_t* async_spawn(const char* name, int (*fn)(task_t* t), void* data);
+void async_set_foreground(task_t* t);
+void async_cancel(task_t* t);
+void async_wait_io(const volatile int* status);
+char async_getkey(task_t* t);
+void async_run(void) __attribute__((noreturn));
+void cmd_tasks(const char* args);
+
+#define TASK_BEGIN(t) switch ((t)->lc) { case 0:
+#define TASK_END(t) } (t)->lc = 0; return TASK_DONE
+
+#define TASK_YIELD(t)                                   \
+    do {                                                \
+        (t)->lc = __LINE__;                             \
+        return TASK_YIELDED;                            \
+    case __LINE__:;                                     \
+    } while (0)
+
+#define AWAIT_KEY(t, c)                                 \
+    do {                                                \
+        (t)->lc = __LINE__;                             \
+        __attribute__((fallthrough));                   \
+    case __LINE__:                                      \
+        if (((c) = async_getkey(t)) == 0) {             \
+            (t)->wait = WAIT_KEY;                       \
+            return TASK_WAITING;                        \
+        }                                               \
+    } while (0)
+
+#define AWAIT_TICKS(t, n)                               \
+    do {                                                \
+        (t)->wake_tick = timer_get_ticks() + (n);       \
+        (t)->wait = WAIT_TICKS;                         \
+        (t)->lc = __LINE__;                             \
+        return TASK_WAITING;                            \
+    case __LINE__:;                                     \
+    } while (0)
+
+#define AWAIT_IO(t, req)                                \
+    do {                                                \
+        (t)->io_status = &(req)->status;                \
+        (t)->lc = __LINE__;                             \
+        __attribute__((fallthrough));                   \
+    case __LINE__:                                      \
+        if (*(t)->io_status == BLOCK_PENDING) {         \
+            (t)->wait = WAIT_IO;                        \
+            return TASK_WAITING;                        \
+        }                                               \
+    } while (0)
 
 #endif
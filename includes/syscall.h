@@ -0,0 +1,48 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include <stdint.h>
+
+#define KERNEL_CODE_SEG 0x08
+#define KERNEL_DATA_SEG 0x10
+#define USER_CODE_SEG 0x1B
+#define USER_DATA_SEG 0x23
+#define TSS_SEG 0x28
+
+#define SYSCALL_VECTOR 0x80
+
+enum syscall_number {
+    SYS_EXIT = 0,
+    SYS_WRITE = 1,
+    SYS_GETCHAR = 2,
+    SYS_NOP = 3,
+    SYS_HAS_SYSENTER = 4,
+    NR_SYSCALLS = 16,
+};
+
+/* User-side entry points. The number goes in eax and up to three arguments
+   in ebx, esi and edi for both paths; SYSENTER additionally needs the
+   return address in edx and the user stack pointer in ecx, which SYSEXIT
+   uses to resume. */
+static inline __attribute__((always_inline)) int syscall_sysenter(int num, int a1, int a2, int a3) {
+    int ret;
+    asm volatile ( "movl %%esp, %%ecx\n\t"
+                   "movl $1f, %%edx\n\t"
+                   "sysenter\n"
+                   "1:"
+                   : "=a"(ret)
+                   : "a"(num), "b"(a1), "S"(a2), "D"(a3)
+                   : "ecx", "edx", "memory" );
+    return ret;
+}
+
+static inline __attribute__((always_inline)) int syscall_int80(int num, int a1, int a2, int a3) {
+    int ret;
+    asm volatile ( "int $0x80"
+                   : "=a"(ret)
+                   : "a"(num), "b"(a1), "S"(a2), "D"(a3)
+                   : "memory" );
+    return ret;
+}
+
+#endif
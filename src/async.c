@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "base_kernel.h"
+
+static task_t tasks[MAX_TASKS];
+static task_t* foreground = NULL;
+static ipc_channel_t* kbd_channel = NULL;
+static task_t* current = NULL;
+static int polling = 0;
+
+static const char* wait_names[] = { "runnable", "key", "timer", "io" };
+
+task_t* async_spawn(const char* name, int (*fn)(task_t* t), void* data) {
+    for (int i = 0; i < MAX_TASKS; i++) {
+        task_t* t = &tasks[i];
+        if (!t->used) {
+            memset(t, 0, sizeof(*t));
+            t->fn = fn;
+            t->name = name;
+            t->data = data;
+            t->used = 1;
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/* The keyboard extension destroys its channel on unload and creates a new
+   one on reload, so the cached pointer is checked and re-resolved on use. */
+static ipc_channel_t* async_kbd_channel(void) {
+    if (!kbd_channel || !kbd_channel->ring || kbd_channel->owner != IPC_OWNER_CORE) {
+        kbd_channel = ipc_lookup("kbd");
+        if (kbd_channel) {
+            ipc_set_receiver(kbd_channel, IPC_OWNER_CORE, NULL);
+        }
+    }
+    return kbd_channel;
+}
+
+/* Keyboard input goes only to the foreground task; when it finishes the
+   task that was in the foreground before it gets the keyboard back. */
+void async_set_foreground(task_t* t) {
+    t->prev_fg = foreground;
+    foreground = t;
+}
+
+char async_getkey(task_t* t) {
+    if (t != foreground) {
+        return 0;
+    }
+    ipc_channel_t* ch = async_kbd_channel();
+    if (!ch) {
+        return read_char_from_kb_buffer();
+    }
+
+    ipc_msg_t msg;
+    while (ipc_recv(ch, IPC_OWNER_CORE, &msg) == 0) {
+        if (msg.type == IPC_MSG_KEY) {
+            return (char)msg.arg;
+        }
+    }
+    return 0;
+}
+
+static int task_ready(task_t* t) {
+    switch (t->wait) {
+    case WAIT_KEY: {
+        if (t != foreground) {
+            return 0;
+        }
+        ipc_channel_t* ch = async_kbd_channel();
+        if (ch) {
+            return ch->tail != ch->committed;
+        }
+        return kb_buffer_pending();
+    }
+    case WAIT_TICKS:
+        return timer_get_ticks() >= t->wake_tick;
+    case WAIT_IO:
+        return *t->io_status != BLOCK_PENDING;
+    default:
+        return 1;
+    }
+}
+
+static void task_exit(task_t* t) {
+    if (foreground == t) {
+        foreground = t->prev_fg;
+    }
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (tasks[i].used && tasks[i].prev_fg == t) {
+            tasks[i].prev_fg = t->prev_fg;
+        }
+    }
+    t->used = 0;
+}
+
+void async_cancel(task_t* t) {
+    if (t && t->used) {
+        task_exit(t);
+    }
+}
+
+static void task_step(task_t* t) {
+    task_t* saved = current;
+    current = t;
+    t->wait = WAIT_NONE;
+    if (t->fn(t) == TASK_DONE) {
+        task_exit(t);
+    }
+    current = saved;
+}
+
+/* Synchronous helpers called from inside a task step cannot await, so
+   while their request is in flight they step the other ready tasks once
+   each instead. Only one level deep: a task stepped from here that blocks
+   in turn just halts, which bounds the stack. */
+static int async_poll_others(void) {
+    int ran = 0;
+    polling = 1;
+    local_irq_enable();
+    for (int i = 0; i < MAX_TASKS; i++) {
+        task_t* t = &tasks[i];
+        if (t->used && t != current && task_ready(t)) {
+            task_step(t);
+            ran = 1;
+        }
+    }
+    polling = 0;
+    return ran;
+}
+
+void async_wait_io(const volatile int* status) {
+    local_irq_disable();
+    while (*status == BLOCK_PENDING) {
+        if (!current || polling || !async_poll_others()) {
+            safe_halt();
+        }
+        local_irq_disable();
+    }
+    local_irq_enable();
+}
+
+static int async_any_ready(void) {
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (tasks[i].used && task_ready(&tasks[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void async_run(void) {
+    async_kbd_channel();
+
+    while (1) {
+        for (int i = 0; i < MAX_TASKS; i++) {
+            task_t* t = &tasks[i];
+            if (t->used && task_ready(t)) {
+                task_step(t);
+            }
+        }
+
+        local_irq_disable();
+        if (async_any_ready()) {
+            local_irq_enable();
+        } else {
+            safe_halt();
+        }
+    }
+}
+
+void cmd_tasks(const char* args) {
+    terminal_writestring("Tasks:\n");
+
+    for (int i = 0; i < MAX_TASKS; i++) {
+        task_t* t = &tasks[i];
+        if (t->used) {
+            kprintf("  %2d %-12s waiting on %-8s%s\n", i, t->name, wait_names[t->wait],
+                    t == foreground ? " [foreground]" : "");
+        }
+    }
+}
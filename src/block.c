@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "base_kernel.h"
+
+static block_device_t* block_devices[MAX_BLOCK_DEVICES];
+static int block_device_count = 0;
+static void (*block_invalidate_hook)(block_device_t* dev) = NULL;
+
+/* One hook, for the buffer cache: it must drop everything it holds for a
+   device before the device is unregistered. */
+void block_set_invalidate_hook(void (*hook)(block_device_t* dev)) {
+    block_invalidate_hook = hook;
+}
+
+int register_block_device(block_device_t* dev) {
+    if (block_device_count >= MAX_BLOCK_DEVICES || !dev->submit) {
+        return -1;
+    }
+
+    dev->id = block_device_count;
+    block_devices[block_device_count++] = dev;
+    return dev->id;
+}
+
+int unregister_block_device(block_device_t* dev) {
+    if (!dev || dev->id < 0 || dev->id >= block_device_count || block_devices[dev->id] != dev) {
+        return -1;
+    }
+
+    if (block_invalidate_hook) {
+        block_invalidate_hook(dev);
+    }
+
+    for (int i = dev->id + 1; i < block_device_count; i++) {
+        block_devices[i - 1] = block_devices[i];
+        block_devices[i - 1]->id = i - 1;
+    }
+    block_device_count--;
+    dev->id = -1;
+    return 0;
+}
+
+block_device_t* get_block_device(int id) {
+    if (id < 0 || id >= block_device_count) {
+        return NULL;
+    }
+    return block_devices[id];
+}
+
+block_device_t* find_block_device(const char* name) {
+    for (int i = 0; i < block_device_count; i++) {
+        if (strcmp(block_devices[i]->name, name) == 0) {
+            return block_devices[i];
+        }
+    }
+    return NULL;
+}
+
+int block_submit(block_device_t* dev, block_request_t* req) {
+    if (!dev || !req || req->nsegs <= 0 || req->nsegs > BLOCK_MAX_SEGMENTS) {
+        return -1;
+    }
+
+    uint32_t bytes = 0;
+    for (int i = 0; i < req->nsegs; i++) {
+        bytes += req->segs[i].len;
+    }
+    if (bytes == 0 || (bytes % BLOCK_SECTOR_SIZE) != 0 ||
+        req->sector + bytes / BLOCK_SECTOR_SIZE > dev->sectors) {
+        return -1;
+    }
+
+    req->status = BLOCK_PENDING;
+    return dev->submit(dev, req);
+}
+
+void block_unplug(block_device_t* dev) {
+    if (dev && dev->unplug) {
+        dev->unplug(dev);
+    }
+}
+
+int block_rw_start(block_device_t* dev, block_request_t* req, uint64_t sector,
+                   void* buf, uint32_t count, int write) {
+    req->sector = sector;
+    req->write = write;
+    req->flags = 0;
+    req->segs[0].addr = buf;
+    req->segs[0].len = count * BLOCK_SECTOR_SIZE;
+    req->nsegs = 1;
+    req->complete = NULL;
+    req->private_data = NULL;
+
+    if (block_submit(dev, req) != 0) {
+        return -1;
+    }
+    block_unplug(dev);
+    return 0;
+}
+
+int block_rw_sync(block_device_t* dev, uint64_t sector, void* buf,
+                  uint32_t count, int write) {
+    block_request_t req;
+    if (block_rw_start(dev, &req, sector, buf, count, write) != 0) {
+        return -1;
+    }
+    async_wait_io(&req.status);
+    return req.status == BLOCK_OK ? 0 : -1;
+}
+
+void cmd_lsblk(const char* args) {
+    terminal_writestring("Block Devices:\n");
+
+    for (int i = 0; i < block_device_count; i++) {
+        kprintf("  %s %llu MiB\n", block_devices[i]->name, block_devices[i]->sectors >> 11);
+    }
+
+    if (block_device_count == 0) {
+        terminal_writestring("  No block devices registered\n");
+    }
+}
@@ -0,0 +1,564 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "base_kernel.h"
+
+#define BCACHE_MAX_BUFFERS 256
+#define BCACHE_HASH_BUCKETS 64
+#define BCACHE_SECTOR_SHIFT 3
+
+#define BCACHE_FLUSH_INTERVAL 500
+#define BCACHE_FLUSH_BATCH 8
+
+#define BCACHE_READAHEAD_TRIGGER 2
+#define BCACHE_READAHEAD_WINDOW 8
+
+#define BUF_VALID 0x01
+#define BUF_DIRTY 0x02
+#define BUF_BUSY 0x04
+#define BUF_READAHEAD 0x08
+
+typedef struct bcache_stream {
+    block_device_t* dev;
+    uint32_t last_block;
+    uint32_t sequential;
+    uint32_t ra_end;
+} bcache_stream_t;
+
+typedef struct bcache_flush_state {
+    bcache_buf_t* issued[BCACHE_FLUSH_BATCH];
+    int count;
+    int i;
+} bcache_flush_state_t;
+
+_Static_assert(sizeof(bcache_flush_state_t) <= TASK_LOCAL_SIZE, "bcache_flush_state_t too large");
+
+static int bcache_ext_id = -1;
+static task_t* flush_task = NULL;
+
+static bcache_buf_t buffers[BCACHE_MAX_BUFFERS];
+static bcache_buf_t* hash_table[BCACHE_HASH_BUCKETS];
+static bcache_buf_t* lru_head = NULL;
+static bcache_buf_t* lru_tail = NULL;
+static int buffer_count = 0;
+static int buffer_live = 0;
+static int buffer_limit = BCACHE_DEFAULT_BUDGET / BCACHE_BLOCK_SIZE;
+static bcache_stream_t streams[MAX_BLOCK_DEVICES];
+
+static uint32_t stat_hits = 0;
+static uint32_t stat_misses = 0;
+static uint32_t stat_ra_issued = 0;
+static uint32_t stat_ra_hits = 0;
+static uint32_t stat_writebacks = 0;
+static uint32_t stat_evictions = 0;
+static volatile uint32_t stat_dirty = 0;
+
+/* Device ids shift when a device is unregistered, so buffers and streams
+   are keyed on the device pointer instead. */
+static inline uint32_t bcache_dev_key(block_device_t* dev) {
+    return (uint32_t)dev >> 4;
+}
+
+static inline uint32_t bcache_hash(block_device_t* dev, uint32_t block) {
+    return (bcache_dev_key(dev) * 31 + block) & (BCACHE_HASH_BUCKETS - 1);
+}
+
+static void lru_unlink(bcache_buf_t* buf) {
+    if (buf->lru_prev) buf->lru_prev->lru_next = buf->lru_next;
+    else lru_head = buf->lru_next;
+    if (buf->lru_next) buf->lru_next->lru_prev = buf->lru_prev;
+    else lru_tail = buf->lru_prev;
+    buf->lru_prev = NULL;
+    buf->lru_next = NULL;
+}
+
+static void lru_push_front(bcache_buf_t* buf) {
+    buf->lru_prev = NULL;
+    buf->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = buf;
+    lru_head = buf;
+    if (!lru_tail) lru_tail = buf;
+}
+
+static void hash_remove(bcache_buf_t* buf) {
+    bcache_buf_t** link = &hash_table[bcache_hash(buf->dev, buf->block)];
+    while (*link) {
+        if (*link == buf) {
+            *link = buf->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+    buf->hash_next = NULL;
+}
+
+static void hash_insert(bcache_buf_t* buf) {
+    uint32_t bucket = bcache_hash(buf->dev, buf->block);
+    buf->hash_next = hash_table[bucket];
+    hash_table[bucket] = buf;
+}
+
+static bcache_buf_t* bcache_lookup(block_device_t* dev, uint32_t block) {
+    for (bcache_buf_t* buf = hash_table[bcache_hash(dev, block)]; buf; buf = buf->hash_next) {
+        if (buf->dev == dev && buf->block == block) {
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+static void bcache_io_done(block_request_t* req) {
+    bcache_buf_t* buf = (bcache_buf_t*)req->private_data;
+
+    if (req->write) {
+        if (req->status == BLOCK_OK) {
+            stat_writebacks++;
+        } else if (!(buf->flags & BUF_DIRTY)) {
+            buf->flags |= BUF_DIRTY;
+            stat_dirty++;
+        }
+    } else if (req->status == BLOCK_OK) {
+        buf->flags |= BUF_VALID;
+    }
+
+    buf->flags &= ~BUF_BUSY;
+}
+
+static int bcache_start_io(bcache_buf_t* buf, int write, int flags) {
+    block_request_t* req = &buf->req;
+    req->sector = (uint64_t)buf->block << BCACHE_SECTOR_SHIFT;
+    req->write = write;
+    req->flags = flags;
+    req->segs[0].addr = buf->data;
+    req->segs[0].len = BCACHE_BLOCK_SIZE;
+    req->nsegs = 1;
+    req->complete = bcache_io_done;
+    req->private_data = buf;
+
+    uint32_t irq_flags = local_irq_save();
+    buf->flags |= BUF_BUSY;
+    local_irq_restore(irq_flags);
+
+    if (block_submit(buf->dev, req) != 0) {
+        irq_flags = local_irq_save();
+        buf->flags &= ~BUF_BUSY;
+        local_irq_restore(irq_flags);
+        return -1;
+    }
+    return 0;
+}
+
+/* The completion handler sets req.status and clears BUF_BUSY in the same
+   interrupt, so a busy buffer's request is always still pending here. */
+static void bcache_wait(bcache_buf_t* buf) {
+    if (buf->flags & BUF_BUSY) {
+        async_wait_io(&buf->req.status);
+    }
+}
+
+static int bcache_write_sync(bcache_buf_t* buf) {
+    uint32_t irq_flags = local_irq_save();
+    buf->flags &= ~BUF_DIRTY;
+    stat_dirty--;
+    local_irq_restore(irq_flags);
+
+    if (bcache_start_io(buf, 1, 0) != 0) {
+        irq_flags = local_irq_save();
+        buf->flags |= BUF_DIRTY;
+        stat_dirty++;
+        local_irq_restore(irq_flags);
+        return -1;
+    }
+    block_unplug(buf->dev);
+    bcache_wait(buf);
+    return (buf->flags & BUF_DIRTY) ? -1 : 0;
+}
+
+static bcache_buf_t* bcache_clean_victim(void) {
+    for (bcache_buf_t* buf = lru_tail; buf; buf = buf->lru_prev) {
+        if (buf->refcount == 0 && !(buf->flags & (BUF_BUSY | BUF_DIRTY))) {
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+static bcache_buf_t* bcache_evict(void) {
+    bcache_buf_t* victim = bcache_clean_victim();
+
+    if (!victim) {
+        for (bcache_buf_t* buf = lru_tail; buf; buf = buf->lru_prev) {
+            if (buf->refcount == 0 && !(buf->flags & BUF_BUSY)) {
+                if (bcache_write_sync(buf) == 0) {
+                    victim = buf;
+                }
+                break;
+            }
+        }
+    }
+
+    if (!victim) {
+        return NULL;
+    }
+
+    stat_evictions++;
+    uint32_t irq_flags = local_irq_save();
+    hash_remove(victim);
+    lru_unlink(victim);
+    local_irq_restore(irq_flags);
+    return victim;
+}
+
+/* Slots below buffer_count whose data was given back by a budget cut are
+   reused before the array grows. */
+static bcache_buf_t* bcache_get_free(void) {
+    if (buffer_live < buffer_limit) {
+        bcache_buf_t* buf = NULL;
+        for (int i = 0; i < buffer_count; i++) {
+            if (!buffers[i].data) {
+                buf = &buffers[i];
+                break;
+            }
+        }
+        if (!buf && buffer_count < BCACHE_MAX_BUFFERS) {
+            buf = &buffers[buffer_count];
+        }
+
+        void* data = buf ? kmalloc(BCACHE_BLOCK_SIZE) : NULL;
+        if (data) {
+            if (buf == &buffers[buffer_count]) {
+                buffer_count++;
+            }
+            buf->data = data;
+            buffer_live++;
+            return buf;
+        }
+    }
+    return bcache_evict();
+}
+
+/* Hands clean, unreferenced buffers back to kmalloc until the cache fits
+   its budget. Dirty ones are left for write-back and normal eviction. */
+static void bcache_shrink(void) {
+    while (buffer_live > buffer_limit) {
+        bcache_buf_t* victim = bcache_clean_victim();
+        if (!victim) {
+            break;
+        }
+
+        uint32_t irq_flags = local_irq_save();
+        hash_remove(victim);
+        lru_unlink(victim);
+        local_irq_restore(irq_flags);
+
+        kfree(victim->data);
+        victim->data = NULL;
+        victim->dev = NULL;
+        victim->flags = 0;
+        buffer_live--;
+        stat_evictions++;
+    }
+}
+
+static bcache_buf_t* bcache_claim(block_device_t* dev, uint32_t block, int readahead) {
+    bcache_buf_t* buf = bcache_get_free();
+    if (!buf) {
+        return NULL;
+    }
+
+    buf->dev = dev;
+    buf->block = block;
+    buf->flags = readahead ? BUF_READAHEAD : 0;
+    buf->refcount = 0;
+
+    uint32_t irq_flags = local_irq_save();
+    hash_insert(buf);
+    if (readahead) {
+        buf->lru_prev = lru_tail;
+        buf->lru_next = NULL;
+        if (lru_tail) lru_tail->lru_next = buf;
+        lru_tail = buf;
+        if (!lru_head) lru_head = buf;
+    } else {
+        lru_push_front(buf);
+    }
+    local_irq_restore(irq_flags);
+    return buf;
+}
+
+static void bcache_readahead(block_device_t* dev, uint32_t block) {
+    bcache_stream_t* stream = &streams[bcache_dev_key(dev) % MAX_BLOCK_DEVICES];
+
+    if (stream->dev != dev || block != stream->last_block + 1) {
+        stream->dev = dev;
+        stream->sequential = 0;
+        stream->ra_end = 0;
+    } else {
+        stream->sequential++;
+    }
+    stream->last_block = block;
+
+    if (stream->sequential < BCACHE_READAHEAD_TRIGGER ||
+        block + BCACHE_READAHEAD_WINDOW / 2 < stream->ra_end) {
+        return;
+    }
+
+    uint32_t start = block + 1 > stream->ra_end ? block + 1 : stream->ra_end;
+    uint32_t end = block + 1 + BCACHE_READAHEAD_WINDOW;
+    uint64_t dev_blocks = dev->sectors >> BCACHE_SECTOR_SHIFT;
+    if (end > dev_blocks) {
+        end = (uint32_t)dev_blocks;
+    }
+
+    int issued = 0;
+    for (uint32_t b = start; b < end; b++) {
+        if (bcache_lookup(dev, b)) {
+            continue;
+        }
+        bcache_buf_t* buf = bcache_claim(dev, b, 1);
+        if (!buf) {
+            break;
+        }
+        if (bcache_start_io(buf, 0, BLOCK_REQ_NOWAIT) != 0) {
+            break;
+        }
+        stat_ra_issued++;
+        issued++;
+    }
+    stream->ra_end = end;
+
+    if (issued) {
+        block_unplug(dev);
+    }
+}
+
+bcache_buf_t* bcache_read(block_device_t* dev, uint32_t block) {
+    if (!dev || dev->id < 0) {
+        return NULL;
+    }
+
+    bcache_buf_t* buf = bcache_lookup(dev, block);
+    if (buf) {
+        stat_hits++;
+        buf->refcount++;
+        uint32_t irq_flags = local_irq_save();
+        if (buf->flags & BUF_READAHEAD) {
+            buf->flags &= ~BUF_READAHEAD;
+            stat_ra_hits++;
+        }
+        lru_unlink(buf);
+        lru_push_front(buf);
+        local_irq_restore(irq_flags);
+    } else {
+        stat_misses++;
+        buf = bcache_claim(dev, block, 0);
+        if (!buf) {
+            return NULL;
+        }
+        buf->refcount++;
+        if (bcache_start_io(buf, 0, 0) != 0) {
+            buf->refcount--;
+            return NULL;
+        }
+        block_unplug(dev);
+    }
+
+    bcache_readahead(dev, block);
+    bcache_wait(buf);
+
+    if (!(buf->flags & BUF_VALID) && bcache_start_io(buf, 0, 0) == 0) {
+        block_unplug(dev);
+        bcache_wait(buf);
+    }
+
+    if (!(buf->flags & BUF_VALID)) {
+        buf->refcount--;
+        return NULL;
+    }
+    return buf;
+}
+
+void bcache_release(bcache_buf_t* buf) {
+    if (buf && buf->refcount > 0) {
+        buf->refcount--;
+    }
+}
+
+void bcache_mark_dirty(bcache_buf_t* buf) {
+    uint32_t irq_flags = local_irq_save();
+    if (!(buf->flags & BUF_DIRTY)) {
+        buf->flags |= BUF_DIRTY;
+        stat_dirty++;
+    }
+    local_irq_restore(irq_flags);
+}
+
+/* Starts write-back of up to BCACHE_FLUSH_BATCH dirty buffers and returns
+   them in issued[] so the caller can await each one. */
+static int bcache_flush_async(bcache_buf_t** issued) {
+    int count = 0;
+    block_device_t* last_dev = NULL;
+
+    for (int i = 0; i < buffer_count && count < BCACHE_FLUSH_BATCH; i++) {
+        bcache_buf_t* buf = &buffers[i];
+        uint32_t irq_flags = local_irq_save();
+        if ((buf->flags & (BUF_DIRTY | BUF_BUSY)) != BUF_DIRTY) {
+            local_irq_restore(irq_flags);
+            continue;
+        }
+        buf->flags &= ~BUF_DIRTY;
+        stat_dirty--;
+        local_irq_restore(irq_flags);
+
+        if (bcache_start_io(buf, 1, BLOCK_REQ_NOWAIT) != 0) {
+            irq_flags = local_irq_save();
+            buf->flags |= BUF_DIRTY;
+            stat_dirty++;
+            local_irq_restore(irq_flags);
+            continue;
+        }
+
+        if (last_dev && last_dev != buf->dev) {
+            block_unplug(last_dev);
+        }
+        last_dev = buf->dev;
+        issued[count++] = buf;
+    }
+
+    if (last_dev) {
+        block_unplug(last_dev);
+    }
+    return count;
+}
+
+int bcache_sync(void) {
+    int errors = 0;
+    for (int i = 0; i < buffer_count; i++) {
+        bcache_buf_t* buf = &buffers[i];
+        bcache_wait(buf);
+        if ((buf->flags & BUF_DIRTY) && bcache_write_sync(buf) != 0) {
+            errors++;
+        }
+    }
+    return errors ? -1 : 0;
+}
+
+void bcache_set_budget(size_t bytes) {
+    int limit = bytes / BCACHE_BLOCK_SIZE;
+    if (limit < 1) limit = 1;
+    if (limit > BCACHE_MAX_BUFFERS) limit = BCACHE_MAX_BUFFERS;
+    buffer_limit = limit;
+    bcache_shrink();
+}
+
+/* Called by the block layer before dev goes away: dirty buffers are
+   written back while the driver can still take them, then every buffer of
+   the device leaves the cache. Buffers somebody still holds are only
+   unhashed and are reclaimed by normal eviction once released. */
+static void bcache_invalidate(block_device_t* dev) {
+    for (int i = 0; i < buffer_count; i++) {
+        bcache_buf_t* buf = &buffers[i];
+        if (!buf->data || buf->dev != dev) {
+            continue;
+        }
+
+        bcache_wait(buf);
+        if ((buf->flags & BUF_DIRTY) && bcache_write_sync(buf) != 0) {
+            uint32_t irq_flags = local_irq_save();
+            buf->flags &= ~BUF_DIRTY;
+            stat_dirty--;
+            local_irq_restore(irq_flags);
+            kprintf("bcache: lost dirty block %u of %s\n", buf->block, dev->name);
+        }
+
+        uint32_t irq_flags = local_irq_save();
+        hash_remove(buf);
+        buf->dev = NULL;
+        buf->flags = 0;
+        if (buf->refcount == 0) {
+            lru_unlink(buf);
+        }
+        local_irq_restore(irq_flags);
+
+        if (buf->refcount == 0) {
+            kfree(buf->data);
+            buf->data = NULL;
+            buffer_live--;
+        }
+    }
+
+    for (int i = 0; i < MAX_BLOCK_DEVICES; i++) {
+        if (streams[i].dev == dev) {
+            streams[i].dev = NULL;
+        }
+    }
+}
+
+/* Background write-back: one batch per interval, and the next interval
+   starts only once the whole batch has landed. */
+static int bcache_flush_task(task_t* t) {
+    bcache_flush_state_t* st = (bcache_flush_state_t*)t->local;
+
+    TASK_BEGIN(t);
+    while (1) {
+        AWAIT_TICKS(t, BCACHE_FLUSH_INTERVAL);
+        if (stat_dirty == 0) {
+            continue;
+        }
+
+        st->count = bcache_flush_async(st->issued);
+        for (st->i = 0; st->i < st->count; st->i++) {
+            AWAIT_IO(t, &st->issued[st->i]->req);
+        }
+    }
+    TASK_END(t);
+}
+
+void cmd_cachestat(const char* args) {
+    uint32_t lookups = stat_hits + stat_misses;
+
+    kprintf("Buffer Cache:\n");
+    kprintf("  buffers: %d / %d (%d KiB budget)\n",
+            buffer_live, buffer_limit, buffer_limit * (BCACHE_BLOCK_SIZE / 1024));
+    kprintf("  hits: %u  misses: %u  hit rate: %u%%\n",
+            stat_hits, stat_misses, lookups ? (stat_hits * 100) / lookups : 0);
+    kprintf("  read-ahead: %u issued, %u used\n", stat_ra_issued, stat_ra_hits);
+    kprintf("  dirty: %u  written back: %u  evictions: %u\n",
+            stat_dirty, stat_writebacks, stat_evictions);
+}
+
+int bcache_extension_init(void) {
+    terminal_writestring("Buffer Cache Extension: Initializing...\n");
+
+    block_set_invalidate_hook(bcache_invalidate);
+
+    flush_task = async_spawn("bcache-flush", bcache_flush_task, NULL);
+    if (!flush_task) {
+        terminal_writestring("Buffer Cache Extension: Periodic flush unavailable.\n");
+    }
+
+    register_command("cachestat", cmd_cachestat, "Buffer cache statistics", bcache_ext_id);
+
+    terminal_writestring("Buffer Cache Extension: Ready.\n");
+    return 0;
+}
+
+void bcache_extension_cleanup(void) {
+    terminal_writestring("Buffer Cache Extension: Cleaning up...\n");
+    async_cancel(flush_task);
+    flush_task = NULL;
+    block_set_invalidate_hook(NULL);
+    bcache_sync();
+    terminal_writestring("Buffer Cache Extension: Cleanup complete.\n");
+}
+
+__attribute__((section(".ext_register_fns")))
+void __bcache_auto_register(void) {
+    bcache_ext_id = register_extension("BufferCache", "1.0",
+                                       bcache_extension_init,
+                                       bcache_extension_cleanup);
+    if (bcache_ext_id >= 0) {
+        load_extension(bcache_ext_id);
+    } else {
+        terminal_writestring("Failed to register Buffer Cache Extension (auto)!\n");
+    }
+}
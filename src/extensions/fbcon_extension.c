@@ -0,0 +1,408 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "base_kernel.h"
+#include "multiboot.h"
+
+#define FONT_WIDTH 8
+#define FONT_HEIGHT 16
+#define GLYPH_CACHE_SLOTS 4
+
+#define FBCON_WIDTH 1280
+#define FBCON_HEIGHT 800
+#define FBCON_BACKBUFFER_ADDR 0x01000000
+#define FBCON_BACKBUFFER_STEP 0x00400000
+
+#define BGA_INDEX_PORT 0x01CE
+#define BGA_DATA_PORT 0x01CF
+#define BGA_INDEX_ID 0
+#define BGA_INDEX_XRES 1
+#define BGA_INDEX_YRES 2
+#define BGA_INDEX_BPP 3
+#define BGA_INDEX_ENABLE 4
+#define BGA_ID_MIN 0xB0C0
+#define BGA_ENABLED 0x01
+#define BGA_LFB_ENABLED 0x40
+#define BGA_VENDOR_ID 0x1234
+#define BGA_DEVICE_ID 0x1111
+#define BGA_DEFAULT_LFB 0xE0000000
+
+#define CPUID_1_EDX_MTRR (1u << 12)
+#define MSR_MTRRCAP 0xFE
+#define MSR_MTRR_DEF_TYPE 0x2FF
+#define MSR_MTRR_PHYSBASE(n) (0x200 + 2 * (n))
+#define MSR_MTRR_PHYSMASK(n) (0x201 + 2 * (n))
+#define MTRRCAP_WC (1u << 10)
+#define MTRR_DEF_TYPE_ENABLE (1u << 11)
+#define MTRR_PHYSMASK_VALID (1u << 11)
+#define MTRR_TYPE_WC 1
+#define CR0_NW (1u << 29)
+#define CR0_CD (1u << 30)
+
+typedef struct glyph_cache_slot {
+    int attr;
+    uint32_t rows[256][FONT_WIDTH];
+} glyph_cache_slot_t;
+
+static int fbcon_ext_id = -1;
+
+static const uint32_t vga_palette[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+static uint8_t font[256][FONT_HEIGHT];
+static glyph_cache_slot_t glyph_cache[GLYPH_CACHE_SLOTS];
+static int glyph_cache_next = 0;
+static uint32_t glyph_cache_fills = 0;
+
+static uint8_t* framebuffer = NULL;
+static uint32_t fb_phys = 0;
+static uint32_t fb_pitch = 0;
+static uint32_t fb_width = 0;
+static uint32_t fb_height = 0;
+static uint32_t* backbuffer = NULL;
+static uint32_t text_rows = 0;
+static uint32_t dirty_top = 0;
+static uint32_t dirty_bottom = 0;
+static int fb_from_bga = 0;
+static int fb_mtrr = -1;
+static int fbcon_active = 0;
+
+static void fbcon_capture_vga_font(void) {
+    volatile uint8_t* plane2 = (volatile uint8_t*)0xA0000;
+
+    outw(0x3C4, 0x0402);
+    outw(0x3C4, 0x0604);
+    outw(0x3CE, 0x0204);
+    outw(0x3CE, 0x0005);
+    outw(0x3CE, 0x0406);
+
+    for (int c = 0; c < 256; c++) {
+        for (int row = 0; row < FONT_HEIGHT; row++) {
+            font[c][row] = plane2[c * 32 + row];
+        }
+    }
+
+    outw(0x3C4, 0x0302);
+    outw(0x3C4, 0x0204);
+    outw(0x3CE, 0x0004);
+    outw(0x3CE, 0x1005);
+    outw(0x3CE, 0x0E06);
+}
+
+static int fbcon_font_valid(void) {
+    uint32_t bits = 0;
+    for (int row = 0; row < FONT_HEIGHT; row++) {
+        bits |= font['A'][row];
+    }
+    return bits != 0;
+}
+
+static uint32_t (*glyph_rows(uint8_t attr))[FONT_WIDTH] {
+    for (int i = 0; i < GLYPH_CACHE_SLOTS; i++) {
+        if (glyph_cache[i].attr == attr) {
+            return glyph_cache[i].rows;
+        }
+    }
+
+    glyph_cache_slot_t* slot = &glyph_cache[glyph_cache_next];
+    glyph_cache_next = (glyph_cache_next + 1) % GLYPH_CACHE_SLOTS;
+    glyph_cache_fills++;
+
+    uint32_t fg = vga_palette[attr & 0x0F];
+    uint32_t bg = vga_palette[(attr >> 4) & 0x0F];
+    for (int bits = 0; bits < 256; bits++) {
+        for (int x = 0; x < FONT_WIDTH; x++) {
+            slot->rows[bits][x] = (bits & (0x80 >> x)) ? fg : bg;
+        }
+    }
+    slot->attr = attr;
+    return slot->rows;
+}
+
+static void fbcon_mark_dirty(uint32_t top, uint32_t bottom) {
+    if (dirty_top == dirty_bottom) {
+        dirty_top = top;
+        dirty_bottom = bottom;
+        return;
+    }
+    if (top < dirty_top) dirty_top = top;
+    if (bottom > dirty_bottom) dirty_bottom = bottom;
+}
+
+static void fbcon_putentryat(char c, uint8_t color, size_t x, size_t y) {
+    uint32_t (*rows)[FONT_WIDTH] = glyph_rows(color);
+    const uint8_t* glyph = font[(uint8_t)c];
+    uint32_t* dst = backbuffer + y * FONT_HEIGHT * fb_width + x * FONT_WIDTH;
+
+    for (int row = 0; row < FONT_HEIGHT; row++) {
+        const uint32_t* src = rows[glyph[row]];
+        for (int px = 0; px < FONT_WIDTH; px++) {
+            dst[px] = src[px];
+        }
+        dst += fb_width;
+    }
+
+    fbcon_mark_dirty(y * FONT_HEIGHT, (y + 1) * FONT_HEIGHT);
+}
+
+static void fbcon_scroll(uint8_t color) {
+    size_t row_pixels = FONT_HEIGHT * fb_width;
+
+    memmove(backbuffer, backbuffer + row_pixels,
+            (text_rows - 1) * row_pixels * sizeof(uint32_t));
+    memsetl(backbuffer + (text_rows - 1) * row_pixels,
+            vga_palette[(color >> 4) & 0x0F], row_pixels);
+
+    fbcon_mark_dirty(0, text_rows * FONT_HEIGHT);
+}
+
+static void fbcon_clear(uint8_t color) {
+    memsetl(backbuffer, vga_palette[(color >> 4) & 0x0F],
+            text_rows * FONT_HEIGHT * fb_width);
+    fbcon_mark_dirty(0, text_rows * FONT_HEIGHT);
+}
+
+static void fbcon_flush(void) {
+    if (dirty_top == dirty_bottom) {
+        return;
+    }
+
+    size_t line_bytes = fb_width * sizeof(uint32_t);
+    if (fb_pitch == line_bytes) {
+        memcpy(framebuffer + dirty_top * fb_pitch, backbuffer + dirty_top * fb_width,
+               (dirty_bottom - dirty_top) * line_bytes);
+    } else {
+        for (uint32_t y = dirty_top; y < dirty_bottom; y++) {
+            memcpy(framebuffer + y * fb_pitch, backbuffer + y * fb_width, line_bytes);
+        }
+    }
+
+    dirty_top = dirty_bottom = 0;
+}
+
+static console_backend_t fbcon_backend = {
+    "VBE framebuffer", 0, 0,
+    fbcon_putentryat, fbcon_scroll, fbcon_clear, fbcon_flush
+};
+
+/* MTRR updates follow the SDM sequence: caches off and flushed, MTRRs disabled. */
+static void fbcon_write_mtrr(int slot, uint64_t base, uint64_t mask) {
+    uint32_t flags = local_irq_save();
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    asm volatile("mov %0, %%cr0; wbinvd" : : "r"((cr0 | CR0_CD) & ~CR0_NW) : "memory");
+
+    uint64_t def_type = rdmsr(MSR_MTRR_DEF_TYPE);
+    wrmsr(MSR_MTRR_DEF_TYPE, def_type & ~(uint64_t)MTRR_DEF_TYPE_ENABLE);
+    wrmsr(MSR_MTRR_PHYSMASK(slot), 0);
+    wrmsr(MSR_MTRR_PHYSBASE(slot), base);
+    wrmsr(MSR_MTRR_PHYSMASK(slot), mask);
+    wrmsr(MSR_MTRR_DEF_TYPE, def_type);
+
+    asm volatile("wbinvd; mov %0, %%cr0" : : "r"(cr0) : "memory");
+    local_irq_restore(flags);
+}
+
+static int fbcon_set_write_combining(uint32_t base, uint32_t size) {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_1_EDX_MTRR)) {
+        return -1;
+    }
+
+    uint64_t cap = rdmsr(MSR_MTRRCAP);
+    if (!(cap & MTRRCAP_WC)) {
+        return -1;
+    }
+
+    uint32_t range = 0x1000;
+    while (range && range < size) {
+        range <<= 1;
+    }
+    if (!range || (base & (range - 1))) {
+        return -1;
+    }
+
+    uint32_t phys_bits = 36;
+    cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x80000008) {
+        cpuid(0x80000008, 0, &eax, &ebx, &ecx, &edx);
+        phys_bits = eax & 0xFF;
+    }
+    uint64_t phys_mask = ((1ULL << phys_bits) - 1) & ~0xFFFULL;
+
+    int slot = -1;
+    for (int i = 0; i < (int)(cap & 0xFF); i++) {
+        if (!(rdmsr(MSR_MTRR_PHYSMASK(i)) & MTRR_PHYSMASK_VALID)) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        return -1;
+    }
+
+    fbcon_write_mtrr(slot, base | MTRR_TYPE_WC,
+                     (~(uint64_t)(range - 1) & phys_mask) | MTRR_PHYSMASK_VALID);
+    return slot;
+}
+
+static void bga_write(uint16_t index, uint16_t value) {
+    outw(BGA_INDEX_PORT, index);
+    outw(BGA_DATA_PORT, value);
+}
+
+static uint16_t bga_read(uint16_t index) {
+    outw(BGA_INDEX_PORT, index);
+    return inw(BGA_DATA_PORT);
+}
+
+static int fbcon_probe_multiboot(multiboot_info_t* mbi) {
+    if (!mbi || !(mbi->flags & MULTIBOOT_INFO_FRAMEBUFFER_INFO) ||
+        mbi->framebuffer_type != MULTIBOOT_FRAMEBUFFER_TYPE_RGB ||
+        mbi->framebuffer_bpp != 32 || (mbi->framebuffer_addr >> 32)) {
+        return -1;
+    }
+
+    fb_phys = (uint32_t)mbi->framebuffer_addr;
+    fb_pitch = mbi->framebuffer_pitch;
+    fb_width = mbi->framebuffer_width;
+    fb_height = mbi->framebuffer_height;
+    return 0;
+}
+
+static int fbcon_probe_bga(void) {
+    if (bga_read(BGA_INDEX_ID) < BGA_ID_MIN) {
+        return -1;
+    }
+
+    pci_device_t* pci = pci_find_device(BGA_VENDOR_ID, BGA_DEVICE_ID, 0);
+    fb_phys = pci ? (pci->bar[0] & 0xFFFFFFF0) : BGA_DEFAULT_LFB;
+    fb_width = FBCON_WIDTH;
+    fb_height = FBCON_HEIGHT;
+    fb_pitch = FBCON_WIDTH * sizeof(uint32_t);
+    fb_from_bga = 1;
+    return 0;
+}
+
+static void bga_set_mode(void) {
+    bga_write(BGA_INDEX_ENABLE, 0);
+    bga_write(BGA_INDEX_XRES, fb_width);
+    bga_write(BGA_INDEX_YRES, fb_height);
+    bga_write(BGA_INDEX_BPP, 32);
+    bga_write(BGA_INDEX_ENABLE, BGA_ENABLED | BGA_LFB_ENABLED);
+}
+
+void cmd_fbinfo(const char* args) {
+    if (!fbcon_active) {
+        terminal_writestring("Framebuffer console: inactive (VGA text mode)\n");
+        return;
+    }
+
+    kprintf("Framebuffer console:\n");
+    kprintf("  source: %s\n", fb_from_bga ? "Bochs VBE adapter" : "multiboot/VBE");
+    kprintf("  mode: %ux%u, pitch %u, at %p\n", fb_width, fb_height, fb_pitch, (void*)fb_phys);
+    kprintf("  text: %ux%u cells\n", fbcon_backend.width, fbcon_backend.height);
+    if (fb_mtrr >= 0) {
+        kprintf("  write-combining: MTRR %d\n", fb_mtrr);
+    } else {
+        kprintf("  write-combining: unavailable\n");
+    }
+    kprintf("  glyph cache: %d slots, %u fills\n", GLYPH_CACHE_SLOTS, glyph_cache_fills);
+}
+
+int fbcon_extension_init(void) {
+    terminal_writestring("Framebuffer Console Extension: Initializing...\n");
+
+    register_command("fbinfo", cmd_fbinfo, "Framebuffer console information", fbcon_ext_id);
+
+    multiboot_info_t* mbi = get_boot_info();
+    if (!mbi || !(mbi->flags & MULTIBOOT_INFO_MEMORY)) {
+        terminal_writestring("Framebuffer Console Extension: No memory map, staying in text mode.\n");
+        return 0;
+    }
+
+    int graphics_boot = fbcon_probe_multiboot(mbi) == 0;
+    if (!graphics_boot) {
+        fbcon_capture_vga_font();
+    }
+    if (!fbcon_font_valid()) {
+        terminal_writestring("Framebuffer Console Extension: No font available, staying in text mode.\n");
+        return 0;
+    }
+    if (!graphics_boot && fbcon_probe_bga() != 0) {
+        terminal_writestring("Framebuffer Console Extension: No linear framebuffer found.\n");
+        return 0;
+    }
+
+    text_rows = fb_height / FONT_HEIGHT;
+    uint32_t backbuffer_bytes = text_rows * FONT_HEIGHT * fb_width * sizeof(uint32_t);
+    uint64_t ram_end = ((uint64_t)mbi->mem_upper + 1024) * 1024;
+    uint32_t backbuffer_addr = FBCON_BACKBUFFER_ADDR;
+    while (!memory_range_free(backbuffer_addr, backbuffer_bytes)) {
+        backbuffer_addr += FBCON_BACKBUFFER_STEP;
+        if (backbuffer_addr < FBCON_BACKBUFFER_ADDR ||
+            backbuffer_addr + (uint64_t)backbuffer_bytes > ram_end) {
+            terminal_writestring("Framebuffer Console Extension: Not enough memory for back buffer.\n");
+            return 0;
+        }
+    }
+
+    for (int i = 0; i < GLYPH_CACHE_SLOTS; i++) {
+        glyph_cache[i].attr = -1;
+    }
+
+    backbuffer = (uint32_t*)backbuffer_addr;
+    framebuffer = (uint8_t*)fb_phys;
+    fb_mtrr = fbcon_set_write_combining(fb_phys, fb_pitch * fb_height);
+
+    if (fb_from_bga) {
+        bga_set_mode();
+    }
+
+    fbcon_backend.width = fb_width / FONT_WIDTH;
+    fbcon_backend.height = text_rows;
+    terminal_set_backend(&fbcon_backend);
+    fbcon_active = 1;
+
+    kprintf("Framebuffer Console Extension: %ux%u, %ux%u text.\n",
+            fb_width, fb_height, fbcon_backend.width, fbcon_backend.height);
+    return 0;
+}
+
+void fbcon_extension_cleanup(void) {
+    terminal_writestring("Framebuffer Console Extension: Cleaning up...\n");
+
+    if (fbcon_active && !fb_from_bga) {
+        /* The bootloader's mode can't be undone; VGA text memory isn't scanned out. */
+        terminal_writestring("Framebuffer Console Extension: bootloader framebuffer stays active.\n");
+        return;
+    }
+
+    if (fbcon_active) {
+        terminal_set_backend(NULL);
+        fbcon_active = 0;
+        bga_write(BGA_INDEX_ENABLE, 0);
+    }
+
+    if (fb_mtrr >= 0) {
+        fbcon_write_mtrr(fb_mtrr, 0, 0);
+        fb_mtrr = -1;
+    }
+
+    terminal_writestring("Framebuffer Console Extension: Cleanup complete.\n");
+}
+
+__attribute__((section(".ext_register_fns")))
+void __fbcon_auto_register(void) {
+    fbcon_ext_id = register_extension("FBConsole", "1.0",
+                                      fbcon_extension_init,
+                                      fbcon_extension_cleanup);
+    if (fbcon_ext_id >= 0) {
+        load_extension(fbcon_ext_id);
+    } else {
+        terminal_writestring("Failed to register Framebuffer Console Extension (auto)!\n");
+    }
+}
@@ -8,6 +8,7 @@ static volatile size_t kb_buffer_head = 0;
 static volatile size_t kb_buffer_tail = 0;
 
 static int irq_kb_ext_id = -1;
+static ipc_channel_t* kbd_channel = NULL;
 
 static const unsigned char kbd_us[128] =
 {
@@ -51,6 +52,11 @@ struct idt_ptr {
 static struct idt_entry global_idt[256];
 static struct idt_ptr global_idt_p;
 
+static void (*irq_handlers[16])(void);
+static uint8_t pic_master_mask = 0xFC;
+static uint8_t pic_slave_mask = 0xFF;
+static int pic_ready = 0;
+
 static void set_local_idt_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags) {
     global_idt[num].base_low = base & 0xFFFF;
     global_idt[num].base_high = (base >> 16) & 0xFFFF;
@@ -59,6 +65,10 @@ static void set_local_idt_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t
     global_idt[num].flags = flags;
 }
 
+void set_idt_gate(uint8_t num, uint32_t base, uint8_t flags) {
+    set_local_idt_gate(num, base, 0x08, flags);
+}
+
 static void pic_remap(void) {
     outb(0x20, 0x11);
     outb(0xA0, 0x11);
@@ -72,16 +82,65 @@ static void pic_remap(void) {
     outb(0xA1, 0x0);
 }
 
+static void pic_apply_masks(void) {
+    outb(0x21, pic_master_mask);
+    outb(0xA1, pic_slave_mask);
+}
+
+int register_irq_handler(uint8_t irq, void (*handler)(void)) {
+    if (irq < 2 || irq >= 16) {
+        return -1;
+    }
+
+    irq_handlers[irq] = handler;
+
+    if (irq >= 8) {
+        pic_slave_mask &= ~(1 << (irq - 8));
+        pic_master_mask &= ~(1 << 2);
+    } else {
+        pic_master_mask &= ~(1 << irq);
+    }
+
+    if (pic_ready) {
+        pic_apply_masks();
+    }
+    return 0;
+}
+
+int unregister_irq_handler(uint8_t irq, void (*handler)(void)) {
+    if (irq < 2 || irq >= 16 || irq_handlers[irq] != handler) {
+        return -1;
+    }
+
+    uint32_t flags = local_irq_save();
+    if (irq >= 8) {
+        pic_slave_mask |= 1 << (irq - 8);
+    } else {
+        pic_master_mask |= 1 << irq;
+    }
+    if (pic_ready) {
+        pic_apply_masks();
+    }
+    irq_handlers[irq] = NULL;
+    local_irq_restore(flags);
+    return 0;
+}
+
+void irq_dispatch_c(int int_no) {
+    int irq = int_no - 0x20;
+
+    if (irq_handlers[irq]) {
+        irq_handlers[irq]();
+    }
+
+    if (irq >= 8) {
+        outb(0xA0, 0x20);
+    }
+    outb(0x20, 0x20);
+}
+
 void generic_isr_handler(int int_no) {
-    terminal_writestring("Interrupt: ");
-    char num_str[10];
-    int i = 0;
-    if (int_no == 0) { num_str[0] = '0'; i = 1; }
-    else { int temp = int_no; while (temp > 0) { num_str[i++] = (temp % 10) + '0'; temp /= 10; } }
-    num_str[i] = '\0';
-    for (int start = 0, end = i - 1; start < end; start++, end--) { char temp = num_str[start]; num_str[start] = num_str[end]; num_str[end] = temp; }
-    terminal_writestring(num_str);
-    terminal_writestring("\n");
+    kprintf("Interrupt: %d\n", int_no);
 }
 
 void keyboard_handler_c() {
@@ -95,12 +154,20 @@ void keyboard_handler_c() {
                 keyboard_buffer[kb_buffer_head] = ascii;
                 kb_buffer_head = next_head;
             }
+            if (kbd_channel) {
+                ipc_send(kbd_channel, irq_kb_ext_id, IPC_MSG_KEY, NULL, 0, (uint8_t)ascii);
+                ipc_commit(kbd_channel, irq_kb_ext_id);
+            }
         }
     }
 
     outb(0x20, 0x20);
 }
 
+int kb_buffer_pending(void) {
+    return kb_buffer_head != kb_buffer_tail;
+}
+
 char read_char_from_kb_buffer() {
     if (kb_buffer_head == kb_buffer_tail) {
         return 0;
@@ -119,40 +186,60 @@ char wait_for_char_from_kb_buffer() {
     return c;
 }
 
-void cmd_cli_input(const char* args) {
+typedef struct cli_state {
+    char input_buffer[VGA_WIDTH + 1];
+    size_t input_idx;
+    char c;
+} cli_state_t;
+
+_Static_assert(sizeof(cli_state_t) <= TASK_LOCAL_SIZE, "cli_state_t too large");
+
+static int cli_input_task(task_t* t) {
+    cli_state_t* st = (cli_state_t*)t->local;
+
+    TASK_BEGIN(t);
     terminal_writestring("Enter command (press Enter to execute, Backspace works, Ctrl+C to exit):\n");
     terminal_writestring("$ ");
-
-    char input_buffer[VGA_WIDTH + 1];
-    size_t input_idx = 0;
+    st->input_idx = 0;
 
     while (1) {
-        char c = wait_for_char_from_kb_buffer();
+        AWAIT_KEY(t, st->c);
 
-        if (c == '\n' || c == '\r') {
-            input_buffer[input_idx] = '\0';
+        if (st->c == '\n' || st->c == '\r') {
+            st->input_buffer[st->input_idx] = '\0';
             terminal_putchar('\n');
-            if (input_idx > 0) {
-                process_command(input_buffer);
+            if (st->input_idx > 0) {
+                process_command(st->input_buffer);
             }
             terminal_writestring("$ ");
-            input_idx = 0;
-        } else if (c == '\b' || c == 0x7F) {
-            if (input_idx > 0) {
-                input_idx--;
+            st->input_idx = 0;
+        } else if (st->c == '\b' || st->c == 0x7F) {
+            if (st->input_idx > 0) {
+                st->input_idx--;
                 terminal_putchar('\b');
                 terminal_putchar(' ');
                 terminal_putchar('\b');
             }
-        } else if (c == 0x03) {
+        } else if (st->c == 0x03) {
             terminal_writestring("^C\n");
-            return;
+            break;
         }
-        else if (input_idx < VGA_WIDTH) {
-            input_buffer[input_idx++] = c;
-            terminal_putchar(c);
+        else if (st->input_idx < VGA_WIDTH) {
+            st->input_buffer[st->input_idx++] = st->c;
+            terminal_putchar(st->c);
         }
     }
+
+    TASK_END(t);
+}
+
+void cmd_cli_input(const char* args) {
+    task_t* t = async_spawn("cli_test", cli_input_task, NULL);
+    if (!t) {
+        terminal_writestring("cli_test: no free task slots\n");
+        return;
+    }
+    async_set_foreground(t);
 }
 
 int irq_kb_extension_init(void) {
@@ -165,21 +252,24 @@ int irq_kb_extension_init(void) {
         set_local_idt_gate(i, 0, 0x08, 0x8E);
     }
 
-    set_local_idt_gate(0x20, (uint32_t)irq0, 0x08, 0x8E);
-    set_local_idt_gate(0x21, (uint32_t)irq1, 0x08, 0x8E);
+    for (int i = 0; i < 16; i++) {
+        set_local_idt_gate(0x20 + i, irq_stub_table[i], 0x08, 0x8E);
+    }
 
     asm volatile("lidt %0" : : "m"(global_idt_p));
 
     pic_remap();
 
-    outb(0x21, 0xFC);
-    outb(0xA1, 0xFF);
+    pic_apply_masks();
+    pic_ready = 1;
 
-    asm volatile("sti");
+    local_irq_enable();
 
     terminal_writestring("IRQ & Keyboard Extension: IDT loaded, PIC remapped, Interrupts enabled.\n");
     terminal_writestring("IRQ & Keyboard Extension: Keyboard ready.\n");
 
+    kbd_channel = ipc_create("kbd", irq_kb_ext_id);
+
     register_command("cli_test", cmd_cli_input, "Test basic keyboard input", irq_kb_ext_id);
 
     return 0;
@@ -187,8 +277,14 @@ int irq_kb_extension_init(void) {
 
 void irq_kb_extension_cleanup(void) {
     terminal_writestring("IRQ & Keyboard Extension: Cleaning up...\n");
-    asm volatile("cli");
-    outb(0x21, inb(0x21) | 0x03);
+    uint32_t flags = local_irq_save();
+    pic_master_mask |= 0x03;
+    pic_apply_masks();
+    local_irq_restore(flags);
+    if (kbd_channel) {
+        ipc_destroy(kbd_channel);
+        kbd_channel = NULL;
+    }
     terminal_writestring("IRQ & Keyboard Extension: Cleanup complete.\n");
 }
 
@@ -3,12 +3,19 @@ section .text
 extern generic_isr_handler
 extern keyboard_handler_c
 extern timer_handler_c
+extern irq_dispatch_c
+extern irqsoff_begin
+extern irqsoff_end
 
 KERNEL_DATA_SEG equ 0x10
 
+; Interrupt gates enter with IF clear and iret restores it, so the stub
+; itself is one interrupts-off section for the tracer. DF is cleared
+; because the interrupted code may be inside memmove's backward copy.
 %macro IRQ_COMMON 1
-    cli
+%%entry:
     pusha
+    cld
     push ds
     push es
     push fs
@@ -20,24 +27,34 @@ KERNEL_DATA_SEG equ 0x10
     mov fs, ax
     mov gs, ax
 
+    push dword %%entry
+    call irqsoff_begin
+    add esp, 4
+
     push byte %1
 
     %if %1 == 0x20
         call timer_handler_c
     %elif %1 == 0x21
         call keyboard_handler_c
+    %elif %1 >= 0x22 && %1 <= 0x2F
+        call irq_dispatch_c
     %else
         call generic_isr_handler
     %endif
 
     add esp, 4
 
+    push dword %%exit
+    call irqsoff_end
+    add esp, 4
+
+%%exit:
     pop gs
     pop fs
     pop es
     pop ds
     popa
-    sti
     iret
 %endmacro
 
@@ -49,10 +66,29 @@ global irq1
 irq1:
     IRQ_COMMON 0x21
 
+%assign irq_num 2
+%rep 14
+global irq%[irq_num]
+irq%[irq_num]:
+    IRQ_COMMON (0x20 + irq_num)
+%assign irq_num irq_num + 1
+%endrep
+
+section .data
+
+global irq_stub_table
+irq_stub_table:
+%assign irq_num 0
+%rep 16
+    dd irq%[irq_num]
+%assign irq_num irq_num + 1
+%endrep
+
+section .text
+
 %macro ISR_NOERRCODE 1
 global isr%1
 isr%1:
-    cli
     push byte 0
     push byte %1
     jmp common_isr_stub
@@ -61,7 +97,6 @@ isr%1:
 %macro ISR_ERRCODE 1
 global isr%1
 isr%1:
-    cli
     push byte %1
     jmp common_isr_stub
 %endmacro
@@ -89,8 +124,11 @@ ISR_NOERRCODE 18
 ISR_NOERRCODE 19
 ISR_NOERRCODE 20
 
+; Exceptions also arrive through interrupt gates, so like IRQ_COMMON the
+; stub is traced from entry to iret and leaves IF to iret.
 common_isr_stub:
     pusha
+    cld
     push ds
     push es
     push fs
@@ -102,10 +140,19 @@ common_isr_stub:
     mov fs, ax
     mov gs, ax
 
-    push dword [esp + 36]
+    push dword common_isr_stub
+    call irqsoff_begin
+    add esp, 4
+
+    push dword [esp + 48]
     call generic_isr_handler
     add esp, 4
 
+    push dword .exit
+    call irqsoff_end
+    add esp, 4
+
+.exit:
     pop gs
     pop fs
     pop es
@@ -113,6 +160,4 @@ common_isr_stub:
     popa
 
     add esp, 8
-
-    sti
     iret
@@ -0,0 +1,151 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "base_kernel.h"
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+#define MAX_PCI_DEVICES 32
+
+static int pci_ext_id = -1;
+
+static pci_device_t pci_devices[MAX_PCI_DEVICES];
+static int pci_device_count = 0;
+static int pci_scanned = 0;
+
+uint32_t pci_config_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    uint32_t address = (1u << 31) | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+                       ((uint32_t)func << 8) | (offset & 0xFC);
+    outl(PCI_CONFIG_ADDRESS, address);
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_config_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t val) {
+    uint32_t address = (1u << 31) | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+                       ((uint32_t)func << 8) | (offset & 0xFC);
+    outl(PCI_CONFIG_ADDRESS, address);
+    outl(PCI_CONFIG_DATA, val);
+}
+
+static void pci_add_device(uint8_t bus, uint8_t slot, uint8_t func, uint32_t id) {
+    if (pci_device_count >= MAX_PCI_DEVICES) {
+        return;
+    }
+
+    pci_device_t* dev = &pci_devices[pci_device_count++];
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->func = func;
+    dev->vendor_id = id & 0xFFFF;
+    dev->device_id = id >> 16;
+
+    uint32_t class_reg = pci_config_read32(bus, slot, func, 0x08);
+    dev->class_code = class_reg >> 24;
+    dev->subclass = (class_reg >> 16) & 0xFF;
+    dev->irq_line = pci_config_read32(bus, slot, func, 0x3C) & 0xFF;
+
+    for (int i = 0; i < 6; i++) {
+        dev->bar[i] = pci_config_read32(bus, slot, func, 0x10 + i * 4);
+    }
+}
+
+static void pci_scan(void) {
+    pci_device_count = 0;
+
+    for (int bus = 0; bus < 256; bus++) {
+        for (int slot = 0; slot < 32; slot++) {
+            uint32_t id = pci_config_read32(bus, slot, 0, 0x00);
+            if ((id & 0xFFFF) == 0xFFFF) {
+                continue;
+            }
+
+            int functions = 1;
+            if (pci_config_read32(bus, slot, 0, 0x0C) & 0x00800000) {
+                functions = 8;
+            }
+
+            for (int func = 0; func < functions; func++) {
+                if (func > 0) {
+                    id = pci_config_read32(bus, slot, func, 0x00);
+                    if ((id & 0xFFFF) == 0xFFFF) {
+                        continue;
+                    }
+                }
+                pci_add_device(bus, slot, func, id);
+            }
+        }
+    }
+
+    pci_scanned = 1;
+}
+
+pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id, int index) {
+    if (!pci_scanned) {
+        pci_scan();
+    }
+
+    for (int i = 0; i < pci_device_count; i++) {
+        if (pci_devices[i].vendor_id == vendor_id &&
+            pci_devices[i].device_id == device_id) {
+            if (index-- == 0) {
+                return &pci_devices[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+void pci_enable_bus_master(pci_device_t* dev) {
+    uint32_t cmd = pci_config_read32(dev->bus, dev->slot, dev->func, 0x04);
+    cmd |= 0x05;
+    cmd &= ~(1u << 10);
+    pci_config_write32(dev->bus, dev->slot, dev->func, 0x04, cmd);
+}
+
+void cmd_lspci(const char* args) {
+    if (!pci_scanned) {
+        pci_scan();
+    }
+
+    terminal_writestring("PCI Devices:\n");
+    for (int i = 0; i < pci_device_count; i++) {
+        pci_device_t* dev = &pci_devices[i];
+        kprintf("  %02x:%02x.%x %04x:%04x class %02x%02x irq %u\n",
+                dev->bus, dev->slot, dev->func, dev->vendor_id, dev->device_id,
+                dev->class_code, dev->subclass, dev->irq_line);
+    }
+
+    if (pci_device_count == 0) {
+        terminal_writestring("  No devices found\n");
+    }
+}
+
+int pci_extension_init(void) {
+    terminal_writestring("PCI Extension: Initializing...\n");
+
+    if (!pci_scanned) {
+        pci_scan();
+    }
+
+    terminal_writestring("PCI Extension: Bus enumeration complete.\n");
+
+    register_command("lspci", cmd_lspci, "List PCI devices", pci_ext_id);
+
+    return 0;
+}
+
+void pci_extension_cleanup(void) {
+    terminal_writestring("PCI Extension: Cleaning up...\n");
+    terminal_writestring("PCI Extension: Cleanup complete.\n");
+}
+
+__attribute__((section(".ext_register_fns")))
+void __pci_auto_register(void) {
+    pci_ext_id = register_extension("PCI", "1.0",
+                                    pci_extension_init,
+                                    pci_extension_cleanup);
+    if (pci_ext_id >= 0) {
+        load_extension(pci_ext_id);
+    } else {
+        terminal_writestring("Failed to register PCI Extension (auto)!\n");
+    }
+}
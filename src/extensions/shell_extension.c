@@ -4,50 +4,70 @@
 
 static int shell_ext_id = -1;
 
-void cmd_shell_handler(const char* args) {
-    terminal_writestring("BASE Shell (Type 'exit' or Ctrl+C to leave, 'help' for commands):\n");
-
+typedef struct shell_state {
     char input_buffer[VGA_WIDTH + 1];
-    size_t input_idx = 0;
+    size_t input_idx;
+    char c;
+} shell_state_t;
+
+_Static_assert(sizeof(shell_state_t) <= TASK_LOCAL_SIZE, "shell_state_t too large");
+
+static int shell_task(task_t* t) {
+    shell_state_t* st = (shell_state_t*)t->local;
+
+    TASK_BEGIN(t);
+    terminal_writestring("BASE Shell (Type 'exit' or Ctrl+C to leave, 'help' for commands):\n");
+    st->input_idx = 0;
 
     while (1) {
         terminal_writestring("kernel> ");
 
         while (1) {
-            char c = wait_for_char_from_kb_buffer();
+            AWAIT_KEY(t, st->c);
 
-            if (c == '\n' || c == '\r') {
-                input_buffer[input_idx] = '\0';
+            if (st->c == '\n' || st->c == '\r') {
+                st->input_buffer[st->input_idx] = '\0';
                 terminal_putchar('\n');
 
-                if (input_idx == 4 &&
-                    input_buffer[0] == 'e' && input_buffer[1] == 'x' &&
-                    input_buffer[2] == 'i' && input_buffer[3] == 't') {
+                if (st->input_idx == 4 &&
+                    st->input_buffer[0] == 'e' && st->input_buffer[1] == 'x' &&
+                    st->input_buffer[2] == 'i' && st->input_buffer[3] == 't') {
                     terminal_writestring("Exiting shell.\n");
-                    return;
+                    return TASK_DONE;
                 }
 
-                if (input_idx > 0) {
-                    process_command(input_buffer);
+                if (st->input_idx > 0) {
+                    process_command(st->input_buffer);
                 }
-                input_idx = 0;
+                st->input_idx = 0;
                 break;
-            } else if (c == '\b' || c == 0x7F) {
-                if (input_idx > 0) {
-                    input_idx--;
+            } else if (st->c == '\b' || st->c == 0x7F) {
+                if (st->input_idx > 0) {
+                    st->input_idx--;
                     terminal_putchar('\b');
                     terminal_putchar(' ');
                     terminal_putchar('\b');
                 }
-            } else if (c == 0x03) {
+            } else if (st->c == 0x03) {
                 terminal_writestring("^C\nExiting shell.\n");
-                return;
-            } else if (input_idx < VGA_WIDTH) {
-                input_buffer[input_idx++] = c;
-                terminal_putchar(c);
+                return TASK_DONE;
+            } else if (st->input_idx < VGA_WIDTH) {
+                st->input_buffer[st->input_idx++] = st->c;
+                terminal_putchar(st->c);
             }
         }
     }
+
+    TASK_END(t);
+}
+
+void cmd_shell_handler(const char* args) {
+    task_t* t = async_spawn("shell", shell_task, NULL);
+    if (!t) {
+        terminal_writestring("shell: no free task slots\n");
+        return;
+    }
+    async_set_foreground(t);
 }
 
 int shell_extension_init(void) {
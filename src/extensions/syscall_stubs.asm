@@ -0,0 +1,155 @@
+section .text
+
+extern syscall_dispatch
+extern irqsoff_begin
+extern irqsoff_end
+
+KERNEL_DATA_SEG equ 0x10
+USER_CODE_SEG equ 0x1B
+USER_DATA_SEG equ 0x23
+
+; Reports one edge of an interrupts-off section to the tracer, with %2 as
+; the site. eax (syscall number or result) survives; ecx and edx do not.
+%macro IRQSOFF_TRACE 2
+    push eax
+    push dword %2
+    call %1
+    add esp, 4
+    pop eax
+%endmacro
+
+; SYSENTER arrives on the task's kernel stack (IA32_SYSENTER_ESP) with
+; eax = number, ebx/esi/edi = arguments, edx = user eip, ecx = user esp.
+global sysenter_entry
+sysenter_entry:
+    cld
+    push ecx
+    push edx
+    push ds
+    push es
+    push ebp
+
+    mov bp, KERNEL_DATA_SEG
+    mov ds, bp
+    mov es, bp
+
+    ; SYSENTER clears IF, so entry up to the sti is one section.
+    IRQSOFF_TRACE irqsoff_begin, sysenter_entry
+    IRQSOFF_TRACE irqsoff_end, .enable
+.enable:
+    sti
+
+    push edi
+    push esi
+    push ebx
+    push eax
+    call syscall_dispatch
+    add esp, 16
+
+.disable:
+    cli
+    IRQSOFF_TRACE irqsoff_begin, .disable
+    IRQSOFF_TRACE irqsoff_end, .exit
+    pop ebp
+    pop es
+    pop ds
+    pop edx
+    pop ecx
+    ; SYSEXIT leaves EFLAGS alone; the sti shadow covers it.
+.exit:
+    sti
+    sysexit
+
+global int80_entry
+int80_entry:
+    cld
+    push ebp
+    push edi
+    push esi
+    push edx
+    push ecx
+    push ebx
+    push ds
+    push es
+
+    mov bp, KERNEL_DATA_SEG
+    mov ds, bp
+    mov es, bp
+
+    IRQSOFF_TRACE irqsoff_begin, int80_entry
+    IRQSOFF_TRACE irqsoff_end, .enable
+.enable:
+    sti
+
+    push edi
+    push esi
+    push ebx
+    push eax
+    call syscall_dispatch
+    add esp, 16
+
+.disable:
+    cli
+    IRQSOFF_TRACE irqsoff_begin, .disable
+    IRQSOFF_TRACE irqsoff_end, .exit
+.exit:
+    pop es
+    pop ds
+    pop ebx
+    pop ecx
+    pop edx
+    pop esi
+    pop edi
+    pop ebp
+    iret
+
+; int user_enter(uint32_t entry, uint32_t user_esp, uint32_t* context)
+; Saves the callee-saved registers and stack pointer into context and drops
+; to ring 3. Returns only when user_return() is called with that context.
+global user_enter
+user_enter:
+    mov eax, [esp + 12]
+    mov [eax + 0], ebx
+    mov [eax + 4], esi
+    mov [eax + 8], edi
+    mov [eax + 12], ebp
+    mov [eax + 16], esp
+
+    mov ecx, [esp + 4]
+    mov edx, [esp + 8]
+
+    mov ax, USER_DATA_SEG
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    push USER_DATA_SEG
+    push edx
+    pushfd
+    or dword [esp], 0x200
+    push USER_CODE_SEG
+    push ecx
+    iret
+
+; void user_return(uint32_t* context, int code)
+global user_return
+user_return:
+    mov ecx, [esp + 4]
+    mov eax, [esp + 8]
+
+    mov dx, KERNEL_DATA_SEG
+    mov ds, dx
+    mov es, dx
+    mov fs, dx
+    mov gs, dx
+
+    mov ebx, [ecx + 0]
+    mov esi, [ecx + 4]
+    mov edi, [ecx + 8]
+    mov ebp, [ecx + 12]
+    mov esp, [ecx + 16]
+    IRQSOFF_TRACE irqsoff_end, .enable
+.enable:
+    sti
+    ret
@@ -4,36 +4,73 @@
 
 static int timer_ext_id = -1;
 
+#define MAX_TIMER_CALLBACKS 8
+
+typedef struct timer_callback {
+    void (*callback)(void);
+    uint32_t interval;
+    uint32_t remaining;
+} timer_callback_t;
+
 static volatile uint64_t ticks = 0;
+static timer_callback_t timer_callbacks[MAX_TIMER_CALLBACKS];
+static int timer_callback_count = 0;
+
+int register_timer_callback(void (*callback)(void), uint32_t interval_ticks) {
+    if (timer_callback_count >= MAX_TIMER_CALLBACKS || interval_ticks == 0) {
+        return -1;
+    }
+
+    timer_callback_t* tc = &timer_callbacks[timer_callback_count];
+    tc->callback = callback;
+    tc->interval = interval_ticks;
+    tc->remaining = interval_ticks;
+    timer_callback_count++;
+    return 0;
+}
+
+int unregister_timer_callback(void (*callback)(void)) {
+    uint32_t flags = local_irq_save();
+    for (int i = 0; i < timer_callback_count; i++) {
+        if (timer_callbacks[i].callback != callback) {
+            continue;
+        }
+        for (int j = i + 1; j < timer_callback_count; j++) {
+            timer_callbacks[j - 1] = timer_callbacks[j];
+        }
+        timer_callback_count--;
+        local_irq_restore(flags);
+        return 0;
+    }
+    local_irq_restore(flags);
+    return -1;
+}
+
+uint64_t timer_get_ticks(void) {
+    uint32_t flags = local_irq_save();
+    uint64_t now = ticks;
+    local_irq_restore(flags);
+    return now;
+}
 
 void timer_handler_c() {
     ticks++;
     outb(0x20, 0x20);
+
+    for (int i = 0; i < timer_callback_count; i++) {
+        if (--timer_callbacks[i].remaining == 0) {
+            timer_callbacks[i].remaining = timer_callbacks[i].interval;
+            timer_callbacks[i].callback();
+        }
+    }
 }
 
 void cmd_uptime(const char* args) {
-    terminal_writestring("System Uptime: ");
-    char num_str[20];
     uint64_t current_ticks = ticks;
+    uint64_t seconds = current_ticks;
+    div64_u32(&seconds, 100);
 
-    int i = 0;
-    if (current_ticks == 0) { num_str[0] = '0'; i = 1; }
-    else { uint64_t temp = current_ticks; while (temp > 0) { num_str[i++] = (temp % 10) + '0'; temp /= 10; } }
-    num_str[i] = '\0';
-    for (int start = 0, end = i - 1; start < end; start++, end--) { char temp = num_str[start]; num_str[start] = num_str[end]; num_str[end] = temp; }
-    terminal_writestring(num_str);
-    terminal_writestring(" ticks\n");
-
-    uint64_t seconds = current_ticks / 100;
-    terminal_writestring(" (~");
-
-    i = 0;
-    if (seconds == 0) { num_str[0] = '0'; i = 1; }
-    else { uint64_t temp = seconds; while (temp > 0) { num_str[i++] = (temp % 10) + '0'; temp /= 10; } }
-    num_str[i] = '\0';
-    for (int start = 0, end = i - 1; start < end; start++, end--) { char temp = num_str[start]; num_str[start] = num_str[end]; num_str[end] = temp; }
-    terminal_writestring(num_str);
-    terminal_writestring(" seconds)\n");
+    kprintf("System Uptime: %llu ticks\n (~%llu seconds)\n", current_ticks, seconds);
 }
 
 int timer_extension_init(void) {
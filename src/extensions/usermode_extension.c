@@ -0,0 +1,307 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "base_kernel.h"
+#include "syscall.h"
+
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+#define CPUID_1_EDX_SEP (1u << 11)
+
+#define MAX_USER_TASKS 4
+#define USER_KSTACK_SIZE 8192
+#define USER_STACK_SIZE 8192
+
+#define GDT_ENTRIES 6
+
+struct gdt_entry {
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t base_mid;
+    uint8_t access;
+    uint8_t granularity;
+    uint8_t base_high;
+} __attribute__((packed));
+
+struct gdt_ptr {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed));
+
+struct tss {
+    uint32_t prev_tss;
+    uint32_t esp0;
+    uint32_t ss0;
+    uint32_t esp1;
+    uint32_t ss1;
+    uint32_t esp2;
+    uint32_t ss2;
+    uint32_t cr3;
+    uint32_t eip;
+    uint32_t eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+typedef struct user_task {
+    int used;
+    void* kernel_stack;
+    void* user_stack;
+    uint32_t context[5];
+    int exit_code;
+} user_task_t;
+
+extern void sysenter_entry(void);
+extern void int80_entry(void);
+extern int user_enter(uint32_t entry, uint32_t user_esp, uint32_t* context);
+extern void user_return(uint32_t* context, int code);
+
+static int usermode_ext_id = -1;
+
+static struct gdt_entry gdt[GDT_ENTRIES];
+static struct gdt_ptr gdt_p;
+static struct tss kernel_tss;
+
+static syscall_fn_t syscall_table[NR_SYSCALLS];
+static user_task_t user_tasks[MAX_USER_TASKS];
+static user_task_t* current_task = NULL;
+static int sysenter_supported = 0;
+static int gdt_installed = 0;
+
+static void set_gdt_entry(int num, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
+    gdt[num].base_low = base & 0xFFFF;
+    gdt[num].base_mid = (base >> 16) & 0xFF;
+    gdt[num].base_high = (base >> 24) & 0xFF;
+    gdt[num].limit_low = limit & 0xFFFF;
+    gdt[num].granularity = ((limit >> 16) & 0x0F) | (gran & 0xF0);
+    gdt[num].access = access;
+}
+
+/* SYSENTER/SYSEXIT derive every selector from IA32_SYSENTER_CS, so the
+   layout is fixed: kernel code, kernel data, user code, user data. */
+static void gdt_install(void) {
+    /* ltr faults on a TSS that is already marked busy. */
+    if (gdt_installed) {
+        return;
+    }
+
+    set_gdt_entry(0, 0, 0, 0, 0);
+    set_gdt_entry(1, 0, 0xFFFFF, 0x9A, 0xC0);
+    set_gdt_entry(2, 0, 0xFFFFF, 0x92, 0xC0);
+    set_gdt_entry(3, 0, 0xFFFFF, 0xFA, 0xC0);
+    set_gdt_entry(4, 0, 0xFFFFF, 0xF2, 0xC0);
+
+    memset(&kernel_tss, 0, sizeof(kernel_tss));
+    kernel_tss.ss0 = KERNEL_DATA_SEG;
+    kernel_tss.iomap_base = sizeof(kernel_tss);
+    set_gdt_entry(5, (uint32_t)&kernel_tss, sizeof(kernel_tss) - 1, 0x89, 0x00);
+
+    gdt_p.limit = sizeof(gdt) - 1;
+    gdt_p.base = (uint32_t)&gdt;
+
+    asm volatile("lgdt %0\n\t"
+                 "ljmp $0x08, $1f\n"
+                 "1:\n\t"
+                 "mov $0x10, %%ax\n\t"
+                 "mov %%ax, %%ds\n\t"
+                 "mov %%ax, %%es\n\t"
+                 "mov %%ax, %%fs\n\t"
+                 "mov %%ax, %%gs\n\t"
+                 "mov %%ax, %%ss"
+                 : : "m"(gdt_p) : "eax", "memory");
+
+    asm volatile("ltr %w0" : : "r"(TSS_SEG));
+    gdt_installed = 1;
+}
+
+static int cpu_has_sysenter(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_1_EDX_SEP)) {
+        return 0;
+    }
+
+    /* Early Pentium Pro parts report SEP without implementing it. */
+    uint32_t family = (eax >> 8) & 0x0F;
+    uint32_t model = (eax >> 4) & 0x0F;
+    uint32_t stepping = eax & 0x0F;
+    return !(family == 6 && model < 3 && stepping < 3);
+}
+
+static void user_task_activate(user_task_t* task) {
+    uint32_t top = (uint32_t)task->kernel_stack + USER_KSTACK_SIZE;
+    kernel_tss.esp0 = top;
+    if (sysenter_supported) {
+        wrmsr(MSR_SYSENTER_ESP, top);
+    }
+    current_task = task;
+}
+
+int register_syscall(int num, syscall_fn_t fn) {
+    if (num < 0 || num >= NR_SYSCALLS || syscall_table[num]) {
+        return -1;
+    }
+    syscall_table[num] = fn;
+    return 0;
+}
+
+int unregister_syscall(int num, syscall_fn_t fn) {
+    if (num < 0 || num >= NR_SYSCALLS || syscall_table[num] != fn) {
+        return -1;
+    }
+    syscall_table[num] = NULL;
+    return 0;
+}
+
+int syscall_dispatch(int num, int a1, int a2, int a3) {
+    if ((uint32_t)num >= NR_SYSCALLS || !syscall_table[num]) {
+        return -1;
+    }
+    return syscall_table[num](a1, a2, a3);
+}
+
+static int user_range_in(uint32_t addr, uint32_t len, uint32_t start, uint32_t end) {
+    return addr >= start && addr <= end && len <= end - addr;
+}
+
+/* User code may only hand the kernel pointers into its image or its own stack. */
+static int user_range_ok(uint32_t addr, uint32_t len) {
+    uint32_t stack = (uint32_t)current_task->user_stack;
+    return user_range_in(addr, len, (uint32_t)_user_image_start, (uint32_t)_user_image_end) ||
+           user_range_in(addr, len, stack, stack + USER_STACK_SIZE);
+}
+
+static int sys_exit(int code, int unused1, int unused2) {
+    (void)unused1;
+    (void)unused2;
+    user_return(current_task->context, code);
+    return 0;
+}
+
+static int sys_write(int buf, int len, int unused) {
+    (void)unused;
+    if (len < 0 || !user_range_ok((uint32_t)buf, (uint32_t)len)) {
+        return -1;
+    }
+    terminal_write((const char*)buf, (size_t)len);
+    return len;
+}
+
+static int sys_getchar(int unused1, int unused2, int unused3) {
+    (void)unused1;
+    (void)unused2;
+    (void)unused3;
+    return (unsigned char)read_char_from_kb_buffer();
+}
+
+static int sys_nop(int unused1, int unused2, int unused3) {
+    (void)unused1;
+    (void)unused2;
+    (void)unused3;
+    return 0;
+}
+
+static int sys_has_sysenter(int unused1, int unused2, int unused3) {
+    (void)unused1;
+    (void)unused2;
+    (void)unused3;
+    return sysenter_supported;
+}
+
+int run_user_program(void (*entry)(void)) {
+    user_task_t* task = NULL;
+    for (int i = 0; i < MAX_USER_TASKS; i++) {
+        if (!user_tasks[i].used) {
+            task = &user_tasks[i];
+            break;
+        }
+    }
+    if (!task || current_task) {
+        return -1;
+    }
+
+    task->kernel_stack = kmalloc(USER_KSTACK_SIZE);
+    task->user_stack = kmalloc(USER_STACK_SIZE);
+    if (!task->kernel_stack || !task->user_stack) {
+        kfree(task->kernel_stack);
+        kfree(task->user_stack);
+        return -1;
+    }
+    task->used = 1;
+
+    user_task_activate(task);
+    uint32_t user_esp = (uint32_t)task->user_stack + USER_STACK_SIZE;
+    task->exit_code = user_enter((uint32_t)entry, user_esp, task->context);
+
+    current_task = NULL;
+    kfree(task->user_stack);
+    kfree(task->kernel_stack);
+    task->used = 0;
+    return task->exit_code;
+}
+
+void cmd_usertest(const char* args) {
+    kprintf("Running user test image (%u bytes) in ring 3 via %s\n",
+            (uint32_t)(_user_image_end - _user_image_start),
+            sysenter_supported ? "SYSENTER" : "int 0x80");
+    int code = run_user_program(user_test_main);
+    kprintf("User program exited with code %d\n", code);
+}
+
+int usermode_extension_init(void) {
+    terminal_writestring("User Mode Extension: Initializing...\n");
+
+    gdt_install();
+
+    register_syscall(SYS_EXIT, sys_exit);
+    register_syscall(SYS_WRITE, sys_write);
+    register_syscall(SYS_GETCHAR, sys_getchar);
+    register_syscall(SYS_NOP, sys_nop);
+    register_syscall(SYS_HAS_SYSENTER, sys_has_sysenter);
+
+    set_idt_gate(SYSCALL_VECTOR, (uint32_t)int80_entry, 0xEE);
+
+    sysenter_supported = cpu_has_sysenter();
+    if (sysenter_supported) {
+        wrmsr(MSR_SYSENTER_CS, KERNEL_CODE_SEG);
+        wrmsr(MSR_SYSENTER_ESP, 0);
+        wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+        terminal_writestring("User Mode Extension: SYSENTER/SYSEXIT fast path enabled.\n");
+    } else {
+        terminal_writestring("User Mode Extension: SYSENTER unsupported, using int 0x80.\n");
+    }
+
+    register_command("usertest", cmd_usertest, "Run the ring 3 test program", usermode_ext_id);
+
+    return 0;
+}
+
+void usermode_extension_cleanup(void) {
+    terminal_writestring("User Mode Extension: Cleaning up...\n");
+    if (sysenter_supported) {
+        wrmsr(MSR_SYSENTER_CS, 0);
+    }
+    set_idt_gate(SYSCALL_VECTOR, 0, 0x0E);
+    unregister_syscall(SYS_EXIT, sys_exit);
+    unregister_syscall(SYS_WRITE, sys_write);
+    unregister_syscall(SYS_GETCHAR, sys_getchar);
+    unregister_syscall(SYS_NOP, sys_nop);
+    unregister_syscall(SYS_HAS_SYSENTER, sys_has_sysenter);
+    terminal_writestring("User Mode Extension: Cleanup complete.\n");
+}
+
+__attribute__((section(".ext_register_fns")))
+void __usermode_auto_register(void) {
+    usermode_ext_id = register_extension("UserMode", "1.0",
+                                         usermode_extension_init,
+                                         usermode_extension_cleanup);
+    if (usermode_ext_id >= 0) {
+        load_extension(usermode_ext_id);
+    } else {
+        terminal_writestring("Failed to register User Mode Extension (auto)!\n");
+    }
+}
@@ -0,0 +1,447 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "base_kernel.h"
+
+#define VIRTIO_VENDOR_ID 0x1AF4
+#define VIRTIO_BLK_LEGACY_DEVICE_ID 0x1001
+
+#define VIRTIO_REG_DEVICE_FEATURES 0x00
+#define VIRTIO_REG_GUEST_FEATURES 0x04
+#define VIRTIO_REG_QUEUE_PFN 0x08
+#define VIRTIO_REG_QUEUE_SIZE 0x0C
+#define VIRTIO_REG_QUEUE_SELECT 0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY 0x10
+#define VIRTIO_REG_DEVICE_STATUS 0x12
+#define VIRTIO_REG_ISR_STATUS 0x13
+#define VIRTIO_BLK_REG_CAPACITY 0x14
+
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER 0x02
+#define VIRTIO_STATUS_DRIVER_OK 0x04
+#define VIRTIO_STATUS_FAILED 0x80
+
+#define VIRTIO_RING_F_EVENT_IDX (1u << 29)
+
+#define VRING_DESC_F_NEXT 1
+#define VRING_DESC_F_WRITE 2
+#define VRING_USED_F_NO_NOTIFY 1
+#define VRING_ALIGN 4096
+
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+
+/* Publish the avail index once this many chains are queued, even without an
+   explicit unplug. */
+#define VIRTIO_BLK_BATCH_MAX 16
+/* Ask the device to interrupt only after this many completions. */
+#define VIRTIO_BLK_COALESCE 8
+
+struct vring_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed));
+
+struct vring_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+};
+
+struct vring_used_elem {
+    uint32_t id;
+    uint32_t len;
+};
+
+struct vring_used {
+    uint16_t flags;
+    uint16_t idx;
+    struct vring_used_elem ring[];
+};
+
+struct virtio_blk_outhdr {
+    uint32_t type;
+    uint32_t ioprio;
+    uint64_t sector;
+} __attribute__((packed));
+
+typedef struct virtio_blk {
+    block_device_t blk;
+    pci_device_t* pci;
+    uint16_t io_base;
+    uint16_t qsize;
+    int event_idx;
+
+    struct vring_desc* desc;
+    volatile struct vring_avail* avail;
+    volatile struct vring_used* used;
+    volatile uint16_t* used_event;
+    volatile uint16_t* avail_event;
+
+    uint16_t free_head;
+    volatile uint16_t num_free;
+    uint16_t avail_shadow;
+    uint16_t avail_published;
+    uint16_t last_used;
+    volatile uint16_t inflight;
+
+    struct virtio_blk_outhdr* headers;
+    volatile uint8_t* status;
+    block_request_t** requests;
+
+    uint32_t submitted;
+    uint32_t kicks;
+    uint32_t interrupts;
+    uint32_t completed;
+} virtio_blk_t;
+
+static int virtio_blk_ext_id = -1;
+static virtio_blk_t vblk;
+static int vblk_present = 0;
+
+static inline int vring_need_event(uint16_t event_idx, uint16_t new_idx, uint16_t old_idx) {
+    return (uint16_t)(new_idx - event_idx - 1) < (uint16_t)(new_idx - old_idx);
+}
+
+static size_t vring_size(uint16_t qsize) {
+    size_t avail_end = sizeof(struct vring_desc) * qsize + sizeof(uint16_t) * (3 + qsize);
+    size_t used_size = sizeof(uint16_t) * 3 + sizeof(struct vring_used_elem) * qsize;
+    return ((avail_end + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1)) +
+           ((used_size + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1));
+}
+
+static void virtio_blk_kick(virtio_blk_t* vb) {
+    uint16_t old_idx = vb->avail_published;
+    uint16_t new_idx = vb->avail_shadow;
+    if (old_idx == new_idx) {
+        return;
+    }
+
+    mb();
+    vb->avail->idx = new_idx;
+    vb->avail_published = new_idx;
+    mb();
+
+    int notify;
+    if (vb->event_idx) {
+        notify = vring_need_event(*vb->avail_event, new_idx, old_idx);
+    } else {
+        notify = !(vb->used->flags & VRING_USED_F_NO_NOTIFY);
+    }
+
+    if (notify) {
+        outw(vb->io_base + VIRTIO_REG_QUEUE_NOTIFY, 0);
+        vb->kicks++;
+    }
+}
+
+static void virtio_blk_free_chain(virtio_blk_t* vb, uint16_t head) {
+    uint16_t idx = head;
+    uint16_t count = 1;
+    while (vb->desc[idx].flags & VRING_DESC_F_NEXT) {
+        idx = vb->desc[idx].next;
+        count++;
+    }
+    vb->desc[idx].next = vb->free_head;
+    vb->free_head = head;
+    vb->num_free += count;
+}
+
+static void virtio_blk_drain(virtio_blk_t* vb) {
+    do {
+        while (vb->last_used != vb->used->idx) {
+            mb();
+            volatile struct vring_used_elem* elem = &vb->used->ring[vb->last_used % vb->qsize];
+            uint16_t head = elem->id;
+            block_request_t* req = vb->requests[head];
+
+            vb->requests[head] = NULL;
+            virtio_blk_free_chain(vb, head);
+            vb->last_used++;
+            vb->inflight--;
+            vb->completed++;
+
+            if (req) {
+                req->status = vb->status[head] == 0 ? BLOCK_OK : BLOCK_ERROR;
+                if (req->complete) {
+                    req->complete(req);
+                }
+            }
+        }
+
+        if (vb->event_idx) {
+            uint16_t batch = vb->inflight < VIRTIO_BLK_COALESCE ? vb->inflight : VIRTIO_BLK_COALESCE;
+            if (batch == 0) {
+                batch = 1;
+            }
+            *vb->used_event = vb->last_used + batch - 1;
+            mb();
+        }
+    } while (vb->last_used != vb->used->idx);
+}
+
+static void virtio_blk_irq(void) {
+    uint8_t isr = inb(vblk.io_base + VIRTIO_REG_ISR_STATUS);
+    if (!(isr & 0x01)) {
+        return;
+    }
+
+    vblk.interrupts++;
+    virtio_blk_drain(&vblk);
+}
+
+static int virtio_blk_submit(block_device_t* dev, block_request_t* req) {
+    virtio_blk_t* vb = (virtio_blk_t*)dev->driver_data;
+    uint16_t needed = req->nsegs + 2;
+
+    if (needed > vb->qsize) {
+        return -1;
+    }
+
+    uint32_t flags = local_irq_save();
+    while (vb->num_free < needed) {
+        virtio_blk_kick(vb);
+        if (req->flags & BLOCK_REQ_NOWAIT) {
+            local_irq_restore(flags);
+            return -1;
+        }
+        /* Interrupts stay off from the check to the hlt, so a completion
+           cannot slip in between and leave us asleep. */
+        safe_halt();
+        local_irq_disable();
+    }
+
+    uint16_t head = vb->free_head;
+    uint16_t idx = head;
+
+    vb->headers[head].type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    vb->headers[head].ioprio = 0;
+    vb->headers[head].sector = req->sector;
+    vb->status[head] = 0xFF;
+
+    vb->desc[idx].addr = (uint32_t)&vb->headers[head];
+    vb->desc[idx].len = sizeof(struct virtio_blk_outhdr);
+    vb->desc[idx].flags = VRING_DESC_F_NEXT;
+    idx = vb->desc[idx].next;
+
+    for (int i = 0; i < req->nsegs; i++) {
+        vb->desc[idx].addr = (uint32_t)req->segs[i].addr;
+        vb->desc[idx].len = req->segs[i].len;
+        vb->desc[idx].flags = VRING_DESC_F_NEXT | (req->write ? 0 : VRING_DESC_F_WRITE);
+        idx = vb->desc[idx].next;
+    }
+
+    vb->desc[idx].addr = (uint32_t)&vb->status[head];
+    vb->desc[idx].len = 1;
+    vb->desc[idx].flags = VRING_DESC_F_WRITE;
+
+    vb->free_head = vb->desc[idx].next;
+    vb->num_free -= needed;
+    vb->requests[head] = req;
+    vb->inflight++;
+    vb->submitted++;
+
+    vb->avail->ring[vb->avail_shadow % vb->qsize] = head;
+    vb->avail_shadow++;
+
+    if ((uint16_t)(vb->avail_shadow - vb->avail_published) >= VIRTIO_BLK_BATCH_MAX) {
+        virtio_blk_kick(vb);
+    }
+
+    local_irq_restore(flags);
+    return 0;
+}
+
+static void virtio_blk_unplug(block_device_t* dev) {
+    virtio_blk_t* vb = (virtio_blk_t*)dev->driver_data;
+    uint32_t flags = local_irq_save();
+    virtio_blk_kick(vb);
+    local_irq_restore(flags);
+}
+
+void cmd_vblkstat(const char* args) {
+    if (!vblk_present) {
+        terminal_writestring("virtio-blk: no device\n");
+        return;
+    }
+
+    kprintf("virtio-blk %s:\n", vblk.blk.name);
+    kprintf("  queue size: %u%s\n", vblk.qsize, vblk.event_idx ? " (event idx)" : "");
+    kprintf("  submitted: %u\n  completed: %u\n", vblk.submitted, vblk.completed);
+    kprintf("  notifications: %u\n  interrupts: %u\n", vblk.kicks, vblk.interrupts);
+    kprintf("  in flight: %u\n", vblk.inflight);
+}
+
+static int virtio_blk_setup_queue(virtio_blk_t* vb) {
+    outw(vb->io_base + VIRTIO_REG_QUEUE_SELECT, 0);
+    vb->qsize = inw(vb->io_base + VIRTIO_REG_QUEUE_SIZE);
+    if (vb->qsize == 0) {
+        return -1;
+    }
+
+    size_t ring_bytes = vring_size(vb->qsize);
+    uint8_t* ring = (uint8_t*)kmalloc(ring_bytes);
+    size_t meta_bytes = vb->qsize * (sizeof(struct virtio_blk_outhdr) + sizeof(uint8_t) +
+                                     sizeof(block_request_t*));
+    uint8_t* meta = (uint8_t*)kmalloc(meta_bytes);
+    if (!ring || !meta) {
+        kfree(ring);
+        kfree(meta);
+        return -1;
+    }
+
+    memset(ring, 0, ring_bytes);
+    memset(meta, 0, meta_bytes);
+
+    size_t avail_off = sizeof(struct vring_desc) * vb->qsize;
+    size_t used_off = (avail_off + sizeof(uint16_t) * (3 + vb->qsize) + VRING_ALIGN - 1) &
+                      ~(VRING_ALIGN - 1);
+
+    vb->desc = (struct vring_desc*)ring;
+    vb->avail = (struct vring_avail*)(ring + avail_off);
+    vb->used = (struct vring_used*)(ring + used_off);
+    vb->used_event = &vb->avail->ring[vb->qsize];
+    vb->avail_event = (volatile uint16_t*)&vb->used->ring[vb->qsize];
+
+    vb->headers = (struct virtio_blk_outhdr*)meta;
+    vb->requests = (block_request_t**)(meta + sizeof(struct virtio_blk_outhdr) * vb->qsize);
+    vb->status = meta + (sizeof(struct virtio_blk_outhdr) + sizeof(block_request_t*)) * vb->qsize;
+
+    for (uint16_t i = 0; i < vb->qsize; i++) {
+        vb->desc[i].next = i + 1;
+    }
+    vb->free_head = 0;
+    vb->num_free = vb->qsize;
+    vb->avail_shadow = 0;
+    vb->avail_published = 0;
+    vb->last_used = 0;
+    vb->inflight = 0;
+
+    outl(vb->io_base + VIRTIO_REG_QUEUE_PFN, (uint32_t)ring / VRING_ALIGN);
+    return 0;
+}
+
+/* Completes whatever the device already finished, fails everything still
+   queued so no submitter waits forever, then resets the device before the
+   ring and request metadata are freed. */
+static void virtio_blk_teardown(virtio_blk_t* vb) {
+    uint32_t flags = local_irq_save();
+    virtio_blk_drain(vb);
+    for (uint16_t i = 0; i < vb->qsize; i++) {
+        block_request_t* req = vb->requests[i];
+        if (!req) {
+            continue;
+        }
+        vb->requests[i] = NULL;
+        req->status = BLOCK_ERROR;
+        if (req->complete) {
+            req->complete(req);
+        }
+    }
+    vb->inflight = 0;
+
+    outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS, 0);
+    outl(vb->io_base + VIRTIO_REG_QUEUE_PFN, 0);
+    local_irq_restore(flags);
+
+    kfree(vb->desc);
+    kfree(vb->headers);
+    vb->desc = NULL;
+    vb->avail = NULL;
+    vb->used = NULL;
+    vb->headers = NULL;
+    vb->requests = NULL;
+    vb->status = NULL;
+    vb->qsize = 0;
+}
+
+int virtio_blk_extension_init(void) {
+    terminal_writestring("Virtio-blk Extension: Initializing...\n");
+
+    register_command("vblkstat", cmd_vblkstat, "Virtio-blk queue statistics", virtio_blk_ext_id);
+
+    pci_device_t* pci = pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_LEGACY_DEVICE_ID, 0);
+    if (!pci || !(pci->bar[0] & 0x01)) {
+        terminal_writestring("Virtio-blk Extension: No device found.\n");
+        return 0;
+    }
+
+    virtio_blk_t* vb = &vblk;
+    vb->pci = pci;
+    vb->io_base = pci->bar[0] & 0xFFFC;
+    pci_enable_bus_master(pci);
+
+    outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS, 0);
+    outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+    uint32_t features = inl(vb->io_base + VIRTIO_REG_DEVICE_FEATURES);
+    uint32_t guest_features = features & VIRTIO_RING_F_EVENT_IDX;
+    outl(vb->io_base + VIRTIO_REG_GUEST_FEATURES, guest_features);
+    vb->event_idx = (guest_features & VIRTIO_RING_F_EVENT_IDX) != 0;
+
+    if (virtio_blk_setup_queue(vb) != 0) {
+        outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+        terminal_writestring("Virtio-blk Extension: Queue setup failed.\n");
+        return -1;
+    }
+
+    vb->blk.sectors = inl(vb->io_base + VIRTIO_BLK_REG_CAPACITY) |
+                      ((uint64_t)inl(vb->io_base + VIRTIO_BLK_REG_CAPACITY + 4) << 32);
+    vb->blk.name[0] = 'v';
+    vb->blk.name[1] = 'd';
+    vb->blk.name[2] = 'a';
+    vb->blk.name[3] = '\0';
+    vb->blk.submit = virtio_blk_submit;
+    vb->blk.unplug = virtio_blk_unplug;
+    vb->blk.driver_data = vb;
+
+    /* Completions only arrive by interrupt; without one every request would
+       wait forever. */
+    if (register_irq_handler(pci->irq_line, virtio_blk_irq) != 0) {
+        virtio_blk_teardown(vb);
+        outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+        kprintf("Virtio-blk Extension: Unusable IRQ line %u.\n", pci->irq_line);
+        return -1;
+    }
+
+    outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS,
+         VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+    if (register_block_device(&vb->blk) < 0) {
+        unregister_irq_handler(pci->irq_line, virtio_blk_irq);
+        virtio_blk_teardown(vb);
+        outb(vb->io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+        terminal_writestring("Virtio-blk Extension: Block device registration failed.\n");
+        return -1;
+    }
+    vblk_present = 1;
+
+    terminal_writestring("Virtio-blk Extension: Device 'vda' ready.\n");
+    return 0;
+}
+
+void virtio_blk_extension_cleanup(void) {
+    terminal_writestring("Virtio-blk Extension: Cleaning up...\n");
+    if (vblk_present) {
+        unregister_block_device(&vblk.blk);
+        vblk.blk.sectors = 0;
+        virtio_blk_teardown(&vblk);
+        unregister_irq_handler(vblk.pci->irq_line, virtio_blk_irq);
+        vblk_present = 0;
+    }
+    terminal_writestring("Virtio-blk Extension: Cleanup complete.\n");
+}
+
+__attribute__((section(".ext_register_fns")))
+void __virtio_blk_auto_register(void) {
+    virtio_blk_ext_id = register_extension("VirtioBlk", "1.0",
+                                           virtio_blk_extension_init,
+                                           virtio_blk_extension_cleanup);
+    if (virtio_blk_ext_id >= 0) {
+        load_extension(virtio_blk_ext_id);
+    } else {
+        terminal_writestring("Failed to register Virtio-blk Extension (auto)!\n");
+    }
+}
@@ -0,0 +1,235 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "base_kernel.h"
+
+#define IPC_MAX_PAGES 64
+#define IPC_PAGE_IN_FLIGHT -2
+#define IPC_SLOT_COMMITTED -32768
+
+typedef struct ipc_page {
+    void* addr;
+    int owner;
+} ipc_page_t;
+
+static ipc_channel_t ipc_channels[IPC_MAX_CHANNELS];
+static int ipc_channel_count = 0;
+static ipc_page_t ipc_pages[IPC_MAX_PAGES];
+/* Sender of each queued but unpublished slot, so a commit publishes only
+   the caller's own messages. Kept beside the ring, which fills its page. */
+static int16_t ipc_slot_sender[IPC_MAX_CHANNELS][IPC_RING_SLOTS];
+
+static ipc_page_t* ipc_page_lookup(void* page) {
+    for (int i = 0; i < IPC_MAX_PAGES; i++) {
+        if (ipc_pages[i].addr == page) {
+            return &ipc_pages[i];
+        }
+    }
+    return NULL;
+}
+
+ipc_channel_t* ipc_create(const char* name, int owner) {
+    if (ipc_lookup(name)) {
+        return NULL;
+    }
+
+    /* Destroyed channels leave a hole so pointers to live ones stay valid. */
+    ipc_channel_t* ch = NULL;
+    for (int i = 0; i < ipc_channel_count; i++) {
+        if (!ipc_channels[i].ring) {
+            ch = &ipc_channels[i];
+            break;
+        }
+    }
+    if (!ch) {
+        if (ipc_channel_count >= IPC_MAX_CHANNELS) {
+            return NULL;
+        }
+        ch = &ipc_channels[ipc_channel_count++];
+    }
+
+    /* kmalloc hands out whole 4 KiB blocks, so the ring is page-aligned. */
+    ipc_msg_t* ring = (ipc_msg_t*)kmalloc(IPC_PAGE_SIZE);
+    if (!ring) {
+        return NULL;
+    }
+
+    memset(ch, 0, sizeof(*ch));
+    strlcpy(ch->name, name, sizeof(ch->name));
+    ch->ring = ring;
+    ch->owner = owner;
+    return ch;
+}
+
+ipc_channel_t* ipc_lookup(const char* name) {
+    for (int i = 0; i < ipc_channel_count; i++) {
+        if (ipc_channels[i].ring && strcmp(ipc_channels[i].name, name) == 0) {
+            return &ipc_channels[i];
+        }
+    }
+    return NULL;
+}
+
+/* Pages still queued on the channel have no owner left, so they are freed
+   along with the ring. */
+void ipc_destroy(ipc_channel_t* ch) {
+    uint32_t flags = local_irq_save();
+    for (uint32_t i = ch->tail; i != ch->head; i++) {
+        void* page = ch->ring[i & (IPC_RING_SLOTS - 1)].page;
+        ipc_page_t* slot = page ? ipc_page_lookup(page) : NULL;
+        if (slot) {
+            kfree(page);
+            slot->addr = NULL;
+        }
+    }
+    kfree(ch->ring);
+    memset(ch, 0, sizeof(*ch));
+    local_irq_restore(flags);
+}
+
+void ipc_set_receiver(ipc_channel_t* ch, int owner, void (*notify)(ipc_channel_t* ch)) {
+    ch->owner = owner;
+    ch->notify = notify;
+}
+
+void* ipc_page_alloc(int owner) {
+    ipc_page_t* slot = ipc_page_lookup(NULL);
+    if (!slot) {
+        return NULL;
+    }
+
+    void* page = kmalloc(IPC_PAGE_SIZE);
+    if (!page) {
+        return NULL;
+    }
+
+    slot->addr = page;
+    slot->owner = owner;
+    return page;
+}
+
+int ipc_page_free(int owner, void* page) {
+    ipc_page_t* slot = ipc_page_lookup(page);
+    if (!page || !slot || slot->owner != owner) {
+        return -1;
+    }
+
+    kfree(page);
+    slot->addr = NULL;
+    return 0;
+}
+
+/* Queues a descriptor without waking the receiver; ipc_commit() publishes
+   everything queued since the last commit with a single notification.
+   Only the page's current owner may send it; it then belongs to the
+   channel until the receiver takes it. */
+int ipc_send(ipc_channel_t* ch, int sender, uint32_t type, void* page, uint32_t len, uint32_t arg) {
+    if (page && len > IPC_PAGE_SIZE) {
+        return -1;
+    }
+
+    uint32_t flags = local_irq_save();
+    ipc_page_t* slot = NULL;
+    if (page) {
+        slot = ipc_page_lookup(page);
+        if (!slot || slot->owner != sender) {
+            local_irq_restore(flags);
+            return -1;
+        }
+    }
+
+    if (ch->head - ch->tail >= IPC_RING_SLOTS) {
+        ch->dropped++;
+        local_irq_restore(flags);
+        return -1;
+    }
+
+    ipc_msg_t* msg = &ch->ring[ch->head & (IPC_RING_SLOTS - 1)];
+    msg->type = type;
+    msg->len = len;
+    msg->page = page;
+    msg->arg = arg;
+    ipc_slot_sender[ch - ipc_channels][ch->head & (IPC_RING_SLOTS - 1)] = (int16_t)sender;
+    if (slot) {
+        slot->owner = IPC_PAGE_IN_FLIGHT;
+    }
+    mb();
+    ch->head++;
+    ch->sent++;
+    local_irq_restore(flags);
+    return 0;
+}
+
+/* Marks the sender's queued slots as published, then advances committed
+   over the leading run of published slots. Another sender's unfinished
+   batch is never exposed, and messages queued behind it wait until it is
+   committed, keeping the ring in order. Runs with interrupts off because
+   the keyboard ISR sends and commits on its own. */
+void ipc_commit(ipc_channel_t* ch, int sender) {
+    int16_t* senders = ipc_slot_sender[ch - ipc_channels];
+    uint32_t flags = local_irq_save();
+    for (uint32_t i = ch->committed; i != ch->head; i++) {
+        if (senders[i & (IPC_RING_SLOTS - 1)] == sender) {
+            senders[i & (IPC_RING_SLOTS - 1)] = IPC_SLOT_COMMITTED;
+        }
+    }
+
+    uint32_t old = ch->committed;
+    while (ch->committed != ch->head &&
+           senders[ch->committed & (IPC_RING_SLOTS - 1)] == IPC_SLOT_COMMITTED) {
+        ch->committed++;
+    }
+    local_irq_restore(flags);
+
+    if (ch->committed != old && ch->notify) {
+        ch->notifications++;
+        ch->notify(ch);
+    }
+}
+
+int ipc_recv(ipc_channel_t* ch, int receiver, ipc_msg_t* out) {
+    if (receiver != ch->owner || ch->tail == ch->committed) {
+        return -1;
+    }
+
+    *out = ch->ring[ch->tail & (IPC_RING_SLOTS - 1)];
+    if (out->page) {
+        ipc_page_t* slot = ipc_page_lookup(out->page);
+        if (slot) {
+            slot->owner = receiver;
+        }
+    }
+    mb();
+    ch->tail++;
+    return 0;
+}
+
+void cmd_ipcstat(const char* args) {
+    terminal_writestring("IPC Channels:\n");
+
+    int channels = 0;
+    for (int i = 0; i < ipc_channel_count; i++) {
+        ipc_channel_t* ch = &ipc_channels[i];
+        if (!ch->ring) {
+            continue;
+        }
+        kprintf("  %-12s owner %2d  queued %3u  sent %u  notifies %u  dropped %u\n",
+                ch->name, ch->owner, ch->head - ch->tail, ch->sent,
+                ch->notifications, ch->dropped);
+        channels++;
+    }
+
+    if (channels == 0) {
+        terminal_writestring("  No channels created\n");
+    }
+
+    int pages = 0, in_flight = 0;
+    for (int i = 0; i < IPC_MAX_PAGES; i++) {
+        if (ipc_pages[i].addr) {
+            pages++;
+            if (ipc_pages[i].owner == IPC_PAGE_IN_FLIGHT) {
+                in_flight++;
+            }
+        }
+    }
+    kprintf("Pages: %d allocated, %d in flight\n", pages, in_flight);
+}
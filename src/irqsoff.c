@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "base_kernel.h"
+
+#define IRQSOFF_TOP_N 8
+#define CPUID_1_EDX_TSC (1u << 4)
+#define TICK_US 10000
+
+typedef struct irqsoff_record {
+    uint64_t cycles;
+    void* start;
+    void* end;
+} irqsoff_record_t;
+
+static irqsoff_record_t irqsoff_worst[IRQSOFF_TOP_N];
+static int irqsoff_enabled = 0;
+static int irqsoff_depth = 0;
+static void* irqsoff_start_ip;
+static uint64_t irqsoff_start_tsc;
+static uint32_t irqsoff_sections = 0;
+
+static uint64_t calib_tsc;
+static uint64_t calib_ticks;
+
+/* Both hooks run with interrupts already disabled, so the tracer state
+   needs no further protection. Sections nest when an exception or stub
+   brackets code that is already inside one; only the outermost end counts. */
+void irqsoff_begin(void* ip) {
+    if (!irqsoff_enabled || irqsoff_depth++ > 0) {
+        return;
+    }
+    irqsoff_start_ip = ip;
+    irqsoff_start_tsc = rdtsc();
+}
+
+void irqsoff_end(void* ip) {
+    if (irqsoff_depth == 0 || --irqsoff_depth > 0) {
+        return;
+    }
+    uint64_t cycles = rdtsc() - irqsoff_start_tsc;
+    irqsoff_sections++;
+
+    if (cycles <= irqsoff_worst[IRQSOFF_TOP_N - 1].cycles) {
+        return;
+    }
+
+    int i = IRQSOFF_TOP_N - 1;
+    while (i > 0 && irqsoff_worst[i - 1].cycles < cycles) {
+        irqsoff_worst[i] = irqsoff_worst[i - 1];
+        i--;
+    }
+    irqsoff_worst[i].cycles = cycles;
+    irqsoff_worst[i].start = irqsoff_start_ip;
+    irqsoff_worst[i].end = ip;
+}
+
+static void irqsoff_reset(void) {
+    uint32_t flags = local_irq_save();
+    memset(irqsoff_worst, 0, sizeof(irqsoff_worst));
+    irqsoff_sections = 0;
+    local_irq_restore(flags);
+}
+
+void irqsoff_initialize(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_1_EDX_TSC)) {
+        return;
+    }
+
+    calib_tsc = rdtsc();
+    calib_ticks = timer_get_ticks();
+    irqsoff_enabled = 1;
+}
+
+void cmd_irqsoff(const char* args) {
+    if (strcmp(args, "on") == 0) {
+        irqsoff_initialize();
+        kprintf("irqsoff tracer %s\n", irqsoff_enabled ? "enabled" : "unavailable (no TSC)");
+        return;
+    } else if (strcmp(args, "off") == 0) {
+        uint32_t flags = local_irq_save();
+        irqsoff_enabled = 0;
+        irqsoff_depth = 0;
+        local_irq_restore(flags);
+        terminal_writestring("irqsoff tracer disabled\n");
+        return;
+    } else if (strcmp(args, "reset") == 0) {
+        irqsoff_reset();
+        terminal_writestring("irqsoff records cleared\n");
+        return;
+    }
+
+    if (!irqsoff_enabled) {
+        terminal_writestring("irqsoff tracer disabled\n");
+        return;
+    }
+
+    /* Derive the TSC rate from PIT ticks elapsed since the tracer started. */
+    uint64_t tick_delta = timer_get_ticks() - calib_ticks;
+    uint32_t cycles_per_us = 0;
+    if (tick_delta > 0 && tick_delta < 0xFFFFFFFFu) {
+        uint64_t per_tick = rdtsc() - calib_tsc;
+        div64_u32(&per_tick, (uint32_t)tick_delta);
+        div64_u32(&per_tick, TICK_US);
+        cycles_per_us = (uint32_t)per_tick;
+    }
+
+    irqsoff_record_t worst[IRQSOFF_TOP_N];
+    uint32_t flags = local_irq_save();
+    memcpy(worst, irqsoff_worst, sizeof(worst));
+    uint32_t sections = irqsoff_sections;
+    local_irq_restore(flags);
+
+    kprintf("Interrupts-off sections: %u traced", sections);
+    if (cycles_per_us) {
+        kprintf(", TSC ~%u MHz", cycles_per_us);
+    }
+    terminal_writestring("\n  #      cycles        us  start       end\n");
+
+    for (int i = 0; i < IRQSOFF_TOP_N && worst[i].cycles; i++) {
+        uint64_t us = worst[i].cycles;
+        if (cycles_per_us) {
+            div64_u32(&us, cycles_per_us);
+        }
+        kprintf("  %d %11llu %9llu  %p  %p\n", i + 1, worst[i].cycles,
+                cycles_per_us ? us : 0, worst[i].start, worst[i].end);
+    }
+}
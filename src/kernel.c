@@ -1,25 +1,77 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "base_kernel.h"
+#include "multiboot.h"
+
+#define BOOT_STACK_SIZE 16384
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+
+__attribute__((used, aligned(16)))
+static uint8_t boot_stack[BOOT_STACK_SIZE];
+static multiboot_info_t* boot_info = NULL;
 
 static size_t terminal_row;
 static size_t terminal_column;
 static uint8_t terminal_color;
 static uint16_t* terminal_buffer;
 
+#define HEAP_START 0x200000
+#define HEAP_SIZE 0x100000
 #define MEMORY_BLOCK_SIZE 4096
 #define MAX_MEMORY_BLOCKS 1024
 
+#define HEAP_SIZE_CLASSES 6
+#define HEAP_TRACE_SIZE 64
+#define HEAP_TRACE_SITES 8
+
 typedef struct memory_block {
     void* address;
     size_t size;
     int is_free;
     struct memory_block* next;
+    void* caller;
+    extension_t* owner;
 } memory_block_t;
 
+typedef struct heap_stats {
+    size_t live_bytes;
+    size_t peak_bytes;
+    uint32_t live_allocs;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failed;
+    uint32_t bad_frees;
+    uint32_t class_live[HEAP_SIZE_CLASSES];
+    uint32_t class_total[HEAP_SIZE_CLASSES];
+} heap_stats_t;
+
+enum heap_trace_op {
+    HEAP_TRACE_ALLOC = 1,
+    HEAP_TRACE_FREE = 2,
+};
+
+typedef struct heap_trace {
+    uint8_t op;
+    void* caller;
+    void* ptr;
+    size_t size;
+    extension_t* owner;
+} heap_trace_t;
+
 static memory_block_t memory_blocks[MAX_MEMORY_BLOCKS];
 static memory_block_t* free_list = NULL;
 static int memory_initialized = 0;
+static uint32_t heap_base = HEAP_START;
+
+static heap_stats_t heap_stats;
+static heap_trace_t heap_trace[HEAP_TRACE_SIZE];
+static uint32_t heap_trace_head = 0;
+static int heap_tracing = 0;
+
+/* Extension that allocations are charged to: set while an extension's
+   init/cleanup runs and while one of its commands executes. */
+static extension_t* heap_owner = NULL;
 
 #define MAX_EXTENSIONS 32
 #define MAX_COMMANDS 64
@@ -30,74 +82,105 @@ static command_t commands[MAX_COMMANDS];
 static int extension_count = 0;
 static int command_count = 0;
 
-size_t strlen(const char* str) {
-    size_t len = 0;
-    while (str[len])
-        len++;
-    return len;
+static void vga_putentryat(char c, uint8_t color, size_t x, size_t y) {
+    const size_t index = y * VGA_WIDTH + x;
+    terminal_buffer[index] = vga_entry(c, color);
 }
 
+static void vga_scroll(uint8_t color) {
+    memmove(terminal_buffer, terminal_buffer + VGA_WIDTH,
+            (VGA_HEIGHT - 1) * VGA_WIDTH * sizeof(uint16_t));
+    memsetw(terminal_buffer + (VGA_HEIGHT - 1) * VGA_WIDTH,
+            vga_entry(' ', color), VGA_WIDTH);
+}
+
+static void vga_clear(uint8_t color) {
+    terminal_buffer = (uint16_t*) VGA_MEMORY;
+    memsetw(terminal_buffer, vga_entry(' ', color), VGA_WIDTH * VGA_HEIGHT);
+}
+
+static console_backend_t vga_backend = {
+    "VGA text mode", VGA_WIDTH, VGA_HEIGHT,
+    vga_putentryat, vga_scroll, vga_clear, NULL
+};
+
+static console_backend_t* console = &vga_backend;
+
 void terminal_initialize(void) {
     terminal_row = 0;
     terminal_column = 0;
     terminal_color = vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
-    terminal_buffer = (uint16_t*) VGA_MEMORY;
 
-    for (size_t y = 0; y < VGA_HEIGHT; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            const size_t index = y * VGA_WIDTH + x;
-            terminal_buffer[index] = vga_entry(' ', terminal_color);
-        }
+    console->clear(terminal_color);
+    if (console->flush) {
+        console->flush();
     }
 }
 
+void terminal_set_backend(console_backend_t* backend) {
+    console = backend ? backend : &vga_backend;
+    terminal_row = 0;
+    terminal_column = 0;
+
+    console->clear(terminal_color);
+    if (console->flush) {
+        console->flush();
+    }
+}
+
+const char* terminal_backend_name(void) {
+    return console->name;
+}
+
+size_t terminal_width(void) {
+    return console->width;
+}
+
+size_t terminal_height(void) {
+    return console->height;
+}
+
 void terminal_setcolor(uint8_t color) {
     terminal_color = color;
 }
 
 void terminal_putentryat(char c, uint8_t color, size_t x, size_t y) {
-    const size_t index = y * VGA_WIDTH + x;
-    terminal_buffer[index] = vga_entry(c, color);
+    console->putentryat(c, color, x, y);
 }
 
-void terminal_scroll(void) {
-    for (size_t y = 0; y < VGA_HEIGHT - 1; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            const size_t src_index = (y + 1) * VGA_WIDTH + x;
-            const size_t dst_index = y * VGA_WIDTH + x;
-            terminal_buffer[dst_index] = terminal_buffer[src_index];
-        }
-    }
-
-    for (size_t x = 0; x < VGA_WIDTH; x++) {
-        const size_t index = (VGA_HEIGHT - 1) * VGA_WIDTH + x;
-        terminal_buffer[index] = vga_entry(' ', terminal_color);
+static void terminal_newline(void) {
+    terminal_column = 0;
+    if (++terminal_row == console->height) {
+        console->scroll(terminal_color);
+        terminal_row = console->height - 1;
     }
 }
 
-void terminal_putchar(char c) {
+static void terminal_emit(char c) {
     if (c == '\n') {
-        terminal_column = 0;
-        if (++terminal_row == VGA_HEIGHT) {
-            terminal_scroll();
-            terminal_row = VGA_HEIGHT - 1;
-        }
+        terminal_newline();
         return;
     }
 
-    terminal_putentryat(c, terminal_color, terminal_column, terminal_row);
-    if (++terminal_column == VGA_WIDTH) {
-        terminal_column = 0;
-        if (++terminal_row == VGA_HEIGHT) {
-            terminal_scroll();
-            terminal_row = VGA_HEIGHT - 1;
-        }
+    console->putentryat(c, terminal_color, terminal_column, terminal_row);
+    if (++terminal_column == console->width) {
+        terminal_newline();
+    }
+}
+
+void terminal_putchar(char c) {
+    terminal_emit(c);
+    if (console->flush) {
+        console->flush();
     }
 }
 
 void terminal_write(const char* data, size_t size) {
     for (size_t i = 0; i < size; i++)
-        terminal_putchar(data[i]);
+        terminal_emit(data[i]);
+    if (console->flush) {
+        console->flush();
+    }
 }
 
 void terminal_writestring(const char* data) {
@@ -105,26 +188,108 @@ void terminal_writestring(const char* data) {
 }
 
 void memory_initialize(void) {
-    for (int i = 0; i < MAX_MEMORY_BLOCKS; i++) {
-        memory_blocks[i].address = NULL;
-        memory_blocks[i].size = 0;
-        memory_blocks[i].is_free = 1;
-        memory_blocks[i].next = NULL;
+    memset(memory_blocks, 0, sizeof(memory_blocks));
+
+    /* Boot modules are loaded above the kernel image; keep the heap clear
+       of them until the module loader has copied them out. */
+    if (boot_info && (boot_info->flags & MULTIBOOT_INFO_MODS)) {
+        multiboot_module_t* mods = (multiboot_module_t*)boot_info->mods_addr;
+        for (uint32_t i = 0; i < boot_info->mods_count; i++) {
+            if (mods[i].mod_end > heap_base) {
+                heap_base = (mods[i].mod_end + MEMORY_BLOCK_SIZE - 1) & ~(MEMORY_BLOCK_SIZE - 1);
+            }
+        }
     }
 
-    memory_blocks[0].address = (void*)0x100000;
-    memory_blocks[0].size = 0x100000;
+    memory_blocks[0].address = (void*)heap_base;
+    memory_blocks[0].size = HEAP_SIZE;
     memory_blocks[0].is_free = 1;
     free_list = &memory_blocks[0];
 
     memory_initialized = 1;
 }
 
+static int ranges_overlap(uint64_t a_start, uint64_t a_end, uint64_t b_start, uint64_t b_end) {
+    return a_start < b_end && b_start < a_end;
+}
+
+/* Reports whether [start, start + len) is RAM that nothing else claims:
+   not the kernel image or heap (everything below the heap's end), the boot
+   modules or the multiboot structures. For buffers too big for the heap. */
+int memory_range_free(uint32_t start, uint32_t len) {
+    uint64_t end = (uint64_t)start + len;
+    if (!boot_info || start < heap_base + HEAP_SIZE) {
+        return 0;
+    }
+
+    uint32_t mbi = (uint32_t)boot_info;
+    if (ranges_overlap(start, end, mbi, mbi + sizeof(*boot_info))) {
+        return 0;
+    }
+
+    if (boot_info->flags & MULTIBOOT_INFO_MODS) {
+        multiboot_module_t* mods = (multiboot_module_t*)boot_info->mods_addr;
+        uint32_t mods_end = boot_info->mods_addr + boot_info->mods_count * sizeof(*mods);
+        if (ranges_overlap(start, end, boot_info->mods_addr, mods_end)) {
+            return 0;
+        }
+        for (uint32_t i = 0; i < boot_info->mods_count; i++) {
+            if (ranges_overlap(start, end, mods[i].mod_start, mods[i].mod_end)) {
+                return 0;
+            }
+        }
+    }
+
+    if (!(boot_info->flags & MULTIBOOT_INFO_MEM_MAP)) {
+        return (boot_info->flags & MULTIBOOT_INFO_MEMORY) &&
+               end <= ((uint64_t)boot_info->mem_upper + 1024) * 1024;
+    }
+
+    uint32_t mmap_end = boot_info->mmap_addr + boot_info->mmap_length;
+    if (ranges_overlap(start, end, boot_info->mmap_addr, mmap_end)) {
+        return 0;
+    }
+    for (uint32_t p = boot_info->mmap_addr; p < mmap_end;) {
+        multiboot_mmap_entry_t* e = (multiboot_mmap_entry_t*)p;
+        if (e->type == MULTIBOOT_MEMORY_AVAILABLE && e->addr <= start &&
+            end <= e->addr + e->len) {
+            return 1;
+        }
+        p += e->size + sizeof(e->size);
+    }
+    return 0;
+}
+
+static int heap_size_class(size_t size) {
+    int cls = 0;
+    size_t pages = size / MEMORY_BLOCK_SIZE;
+    while (pages > 1 && cls < HEAP_SIZE_CLASSES - 1) {
+        pages = (pages + 1) >> 1;
+        cls++;
+    }
+    return cls;
+}
+
+static void heap_trace_record(uint8_t op, void* caller, void* ptr, size_t size,
+                              extension_t* owner) {
+    if (!heap_tracing) {
+        return;
+    }
+
+    heap_trace_t* t = &heap_trace[heap_trace_head++ % HEAP_TRACE_SIZE];
+    t->op = op;
+    t->caller = caller;
+    t->ptr = ptr;
+    t->size = size;
+    t->owner = owner;
+}
+
 void* kmalloc(size_t size) {
     if (!memory_initialized) {
         memory_initialize();
     }
 
+    void* caller = __builtin_return_address(0);
     size = (size + MEMORY_BLOCK_SIZE - 1) & ~(MEMORY_BLOCK_SIZE - 1);
 
     memory_block_t* current = free_list;
@@ -146,11 +311,28 @@ void* kmalloc(size_t size) {
                 }
             }
 
+            current->caller = caller;
+            current->owner = heap_owner;
+
+            int cls = heap_size_class(current->size);
+            heap_stats.class_live[cls]++;
+            heap_stats.class_total[cls]++;
+            heap_stats.allocs++;
+            heap_stats.live_allocs++;
+            heap_stats.live_bytes += current->size;
+            if (heap_stats.live_bytes > heap_stats.peak_bytes) {
+                heap_stats.peak_bytes = heap_stats.live_bytes;
+            }
+            heap_trace_record(HEAP_TRACE_ALLOC, caller, current->address,
+                              current->size, heap_owner);
+
             return current->address;
         }
         current = current->next;
     }
 
+    heap_stats.failed++;
+    heap_trace_record(HEAP_TRACE_ALLOC, caller, NULL, size, heap_owner);
     return NULL;
 }
 
@@ -158,11 +340,24 @@ void kfree(void* ptr) {
     if (ptr == NULL) return;
 
     for (int i = 0; i < MAX_MEMORY_BLOCKS; i++) {
-        if (memory_blocks[i].address == ptr) {
-            memory_blocks[i].is_free = 1;
-            break;
+        memory_block_t* block = &memory_blocks[i];
+        if (block->address == ptr) {
+            if (block->is_free) {
+                break;
+            }
+            block->is_free = 1;
+
+            heap_stats.class_live[heap_size_class(block->size)]--;
+            heap_stats.frees++;
+            heap_stats.live_allocs--;
+            heap_stats.live_bytes -= block->size;
+            heap_trace_record(HEAP_TRACE_FREE, __builtin_return_address(0), ptr,
+                              block->size, block->owner);
+            return;
         }
     }
+
+    heap_stats.bad_frees++;
 }
 
 int register_extension(const char* name, const char* version,
@@ -173,16 +368,8 @@ int register_extension(const char* name, const char* version,
 
     extension_t* ext = &extensions[extension_count];
 
-    int i;
-    for (i = 0; i < 31 && name[i] != '\0'; i++) {
-        ext->name[i] = name[i];
-    }
-    ext->name[i] = '\0';
-
-    for (i = 0; i < 15 && version[i] != '\0'; i++) {
-        ext->version[i] = version[i];
-    }
-    ext->version[i] = '\0';
+    strlcpy(ext->name, name, sizeof(ext->name));
+    strlcpy(ext->version, version, sizeof(ext->version));
 
     ext->init = init_func;
     ext->cleanup = cleanup_func;
@@ -202,7 +389,11 @@ int load_extension(int ext_id) {
         return 0;
     }
 
-    if (ext->init && ext->init() != 0) {
+    extension_t* saved_owner = heap_owner;
+    heap_owner = ext;
+    int ret = ext->init ? ext->init() : 0;
+    heap_owner = saved_owner;
+    if (ret != 0) {
         return -1;
     }
 
@@ -221,13 +412,53 @@ int unload_extension(int ext_id) {
     }
 
     if (ext->cleanup) {
+        extension_t* saved_owner = heap_owner;
+        heap_owner = ext;
         ext->cleanup();
+        heap_owner = saved_owner;
     }
 
     ext->active = 0;
     return 0;
 }
 
+int get_extension_count(void) {
+    return extension_count;
+}
+
+int unregister_commands(int ext_id) {
+    if (ext_id < 0 || ext_id >= extension_count) {
+        return -1;
+    }
+
+    extension_t* owner = &extensions[ext_id];
+    int kept = 0;
+    for (int i = 0; i < command_count; i++) {
+        if (commands[i].owner != owner) {
+            commands[kept++] = commands[i];
+        }
+    }
+
+    int removed = command_count - kept;
+    command_count = kept;
+    return removed;
+}
+
+/* Extension ids are slot indices, so a removed extension leaves an empty
+   slot behind rather than shifting the others. */
+int unregister_extension(int ext_id) {
+    if (unload_extension(ext_id) != 0) {
+        return -1;
+    }
+    unregister_commands(ext_id);
+
+    extension_t* ext = &extensions[ext_id];
+    ext->name[0] = '\0';
+    ext->init = NULL;
+    ext->cleanup = NULL;
+    return 0;
+}
+
 int register_command(const char* name, void (*handler)(const char*),
                      const char* description, int ext_id) {
     if (command_count >= MAX_COMMANDS) {
@@ -240,16 +471,9 @@ int register_command(const char* name, void (*handler)(const char*),
         commands[command_count].owner = NULL;
     }
 
-    int i;
-    for (i = 0; i < MAX_COMMAND_NAME - 1 && name[i] != '\0'; i++) {
-        commands[command_count].name[i] = name[i];
-    }
-    commands[command_count].name[i] = '\0';
-
-    for (i = 0; i < 63 && description[i] != '\0'; i++) {
-        commands[command_count].description[i] = description[i];
-    }
-    commands[command_count].description[i] = '\0';
+    strlcpy(commands[command_count].name, name, MAX_COMMAND_NAME);
+    strlcpy(commands[command_count].description, description,
+            sizeof(commands[command_count].description));
 
     commands[command_count].handler = handler;
     command_count++;
@@ -280,16 +504,12 @@ void cmd_help(const char* args) {
     terminal_writestring("====================\n");
 
     for (int i = 0; i < command_count; i++) {
-        terminal_writestring("  ");
-        terminal_writestring(commands[i].name);
-        terminal_writestring(" - ");
-        terminal_writestring(commands[i].description);
         if (commands[i].owner) {
-            terminal_writestring(" [");
-            terminal_writestring(commands[i].owner->name);
-            terminal_writestring("]");
+            kprintf("  %s - %s [%s]\n", commands[i].name, commands[i].description,
+                    commands[i].owner->name);
+        } else {
+            kprintf("  %s - %s\n", commands[i].name, commands[i].description);
         }
-        terminal_writestring("\n");
     }
 }
 
@@ -299,7 +519,9 @@ void cmd_info(const char* args) {
     terminal_writestring("System Information:\n");
     terminal_writestring("- Architecture: x86\n");
     terminal_writestring("- Memory Management: Basic allocator\n");
-    terminal_writestring("- Terminal: VGA text mode\n");
+    kprintf("- Memory primitives: %s\n", string_impl());
+    kprintf("- Terminal: %s (%ux%u)\n", terminal_backend_name(),
+            terminal_width(), terminal_height());
     terminal_writestring("- Extensions: Supported (Auto-discovery)\n");
     terminal_writestring("- Status: Running\n\n");
 }
@@ -311,11 +533,7 @@ void cmd_extensions(const char* args) {
     int active_count = 0;
     for (int i = 0; i < extension_count; i++) {
         if (extensions[i].active) {
-            terminal_writestring("  ");
-            terminal_writestring(extensions[i].name);
-            terminal_writestring(" v");
-            terminal_writestring(extensions[i].version);
-            terminal_writestring(" [ACTIVE]\n");
+            kprintf("  %s v%s [ACTIVE]\n", extensions[i].name, extensions[i].version);
             active_count++;
         }
     }
@@ -327,12 +545,8 @@ void cmd_extensions(const char* args) {
     terminal_writestring("\nAvailable Extensions (Not Loaded):\n");
     int available_count = 0;
     for (int i = 0; i < extension_count; i++) {
-        if (!extensions[i].active) {
-            terminal_writestring("  ");
-            terminal_writestring(extensions[i].name);
-            terminal_writestring(" v");
-            terminal_writestring(extensions[i].version);
-            terminal_writestring(" [AVAILABLE]\n");
+        if (!extensions[i].active && extensions[i].name[0]) {
+            kprintf("  %s v%s [AVAILABLE]\n", extensions[i].name, extensions[i].version);
             available_count++;
         }
     }
@@ -343,11 +557,143 @@ void cmd_extensions(const char* args) {
     }
 }
 
+static void mem_show_summary(void) {
+    static const char* class_names[HEAP_SIZE_CLASSES] = {
+        "4K", "8K", "16K", "32K", "64K", "128K+"
+    };
+    uint32_t class_free[HEAP_SIZE_CLASSES] = { 0 };
+    size_t free_bytes = 0, largest_free = 0;
+    uint32_t free_blocks = 0;
+    size_t owner_bytes[MAX_EXTENSIONS + 1] = { 0 };
+    uint32_t owner_allocs[MAX_EXTENSIONS + 1] = { 0 };
+
+    for (memory_block_t* b = free_list; b != NULL; b = b->next) {
+        if (b->is_free) {
+            class_free[heap_size_class(b->size)]++;
+            free_bytes += b->size;
+            free_blocks++;
+            if (b->size > largest_free) {
+                largest_free = b->size;
+            }
+        } else {
+            int idx = b->owner ? (int)(b->owner - extensions) + 1 : 0;
+            owner_bytes[idx] += b->size;
+            owner_allocs[idx]++;
+        }
+    }
+
+    kprintf("Heap: 0x%x - 0x%x, %u KiB blocks\n", heap_base,
+            heap_base + HEAP_SIZE - 1, MEMORY_BLOCK_SIZE / 1024);
+    kprintf("  Live: %u KiB in %u allocations (peak %u KiB)\n",
+            heap_stats.live_bytes / 1024, heap_stats.live_allocs,
+            heap_stats.peak_bytes / 1024);
+    kprintf("  Calls: %u kmalloc, %u kfree, %u failed, %u bad frees\n",
+            heap_stats.allocs, heap_stats.frees, heap_stats.failed,
+            heap_stats.bad_frees);
+
+    terminal_writestring("  Class   live  total   free\n");
+    for (int i = 0; i < HEAP_SIZE_CLASSES; i++) {
+        kprintf("  %-6s %5u %6u %6u\n", class_names[i], heap_stats.class_live[i],
+                heap_stats.class_total[i], class_free[i]);
+    }
+
+    /* 0 when all free memory is one extent, approaching 100 as it splinters. */
+    uint32_t frag = free_bytes ? 100 - (uint32_t)(largest_free * 100 / free_bytes) : 0;
+    kprintf("  Free: %u KiB in %u blocks, largest %u KiB, fragmentation %u%%\n",
+            free_bytes / 1024, free_blocks, largest_free / 1024, frag);
+
+    terminal_writestring("By owner:\n");
+    for (int i = 0; i <= extension_count; i++) {
+        if (owner_allocs[i] == 0) {
+            continue;
+        }
+        if (i == 0) {
+            kprintf("  %-16s %5u KiB  %u allocations\n", "core",
+                    owner_bytes[i] / 1024, owner_allocs[i]);
+        } else {
+            extension_t* ext = &extensions[i - 1];
+            kprintf("  %-16s %5u KiB  %u allocations%s\n", ext->name,
+                    owner_bytes[i] / 1024, owner_allocs[i],
+                    ext->active ? "" : "  [unloaded, leaked]");
+        }
+    }
+}
+
+static void mem_show_trace(void) {
+    uint32_t count = heap_trace_head < HEAP_TRACE_SIZE ? heap_trace_head : HEAP_TRACE_SIZE;
+    kprintf("Allocation trace (%s, last %u of %u events):\n",
+            heap_tracing ? "on" : "off", count, heap_trace_head);
+
+    for (uint32_t i = heap_trace_head - count; i != heap_trace_head; i++) {
+        heap_trace_t* t = &heap_trace[i % HEAP_TRACE_SIZE];
+        kprintf("  %s %p %6u bytes from %p [%s]\n",
+                t->op == HEAP_TRACE_ALLOC ? "alloc" : "free ", t->ptr, t->size,
+                t->caller, t->owner ? t->owner->name : "core");
+    }
+}
+
+static void mem_show_sites(void) {
+    void* site_caller[HEAP_TRACE_SITES];
+    size_t site_bytes[HEAP_TRACE_SITES];
+    uint32_t site_count[HEAP_TRACE_SITES];
+    int sites = 0;
+
+    uint32_t count = heap_trace_head < HEAP_TRACE_SIZE ? heap_trace_head : HEAP_TRACE_SIZE;
+    for (uint32_t i = heap_trace_head - count; i != heap_trace_head; i++) {
+        heap_trace_t* t = &heap_trace[i % HEAP_TRACE_SIZE];
+        if (t->op != HEAP_TRACE_ALLOC) {
+            continue;
+        }
+
+        int s = 0;
+        while (s < sites && site_caller[s] != t->caller) {
+            s++;
+        }
+        if (s == sites) {
+            if (sites == HEAP_TRACE_SITES) {
+                continue;
+            }
+            site_caller[s] = t->caller;
+            site_bytes[s] = 0;
+            site_count[s] = 0;
+            sites++;
+        }
+        site_bytes[s] += t->size;
+        site_count[s]++;
+    }
+
+    terminal_writestring("Hot allocation sites (from trace):\n");
+    while (sites > 0) {
+        int best = 0;
+        for (int s = 1; s < sites; s++) {
+            if (site_bytes[s] > site_bytes[best]) {
+                best = s;
+            }
+        }
+        kprintf("  %p %6u KiB in %u calls\n", site_caller[best],
+                site_bytes[best] / 1024, site_count[best]);
+
+        sites--;
+        site_caller[best] = site_caller[sites];
+        site_bytes[best] = site_bytes[sites];
+        site_count[best] = site_count[sites];
+    }
+}
+
 void cmd_mem(const char* args) {
-    terminal_writestring("Memory Status:\n");
-    terminal_writestring("- Memory manager: Active\n");
-    terminal_writestring("- Basic allocation in 0x100000 - 0x1FFFFF region\n");
-    terminal_writestring("- Free blocks available (coalescing TODO)\n");
+    if (strcmp(args, "trace on") == 0) {
+        heap_tracing = 1;
+        terminal_writestring("Allocation tracing enabled\n");
+    } else if (strcmp(args, "trace off") == 0) {
+        heap_tracing = 0;
+        terminal_writestring("Allocation tracing disabled\n");
+    } else if (strcmp(args, "trace") == 0) {
+        mem_show_trace();
+    } else if (strcmp(args, "sites") == 0) {
+        mem_show_sites();
+    } else {
+        mem_show_summary();
+    }
 }
 
 void cmd_clear(const char* args) {
@@ -360,8 +706,14 @@ void init_core_commands(void) {
     register_command("help", cmd_help, "Show available commands", -1);
     register_command("info", cmd_info, "System information", -1);
     register_command("ext", cmd_extensions, "List extensions", -1);
-    register_command("mem", cmd_mem, "Memory status", -1);
+    register_command("mem", cmd_mem, "Heap usage [trace on|off|sites]", -1);
     register_command("clear", cmd_clear, "Clear screen", -1);
+    register_command("lsblk", cmd_lsblk, "List block devices", -1);
+    register_command("ipcstat", cmd_ipcstat, "List IPC channels", -1);
+    register_command("lsmod", cmd_lsmod, "List loaded modules", -1);
+    register_command("rmmod", cmd_rmmod, "Unload a module", -1);
+    register_command("tasks", cmd_tasks, "List cooperative tasks", -1);
+    register_command("irqsoff", cmd_irqsoff, "Worst interrupts-off sections [on|off|reset]", -1);
 }
 
 void process_command(const char* input) {
@@ -380,29 +732,30 @@ void process_command(const char* input) {
     while (input[i] == ' ') i++;
     args = &input[i];
 
-    terminal_writestring("$ ");
-    terminal_writestring(input);
-    terminal_writestring("\n");
+    kprintf("$ %s\n", input);
 
     command_t* cmd = find_command(command);
     if (cmd) {
         if (cmd->owner && !cmd->owner->active) {
-            terminal_writestring("Error: Extension '");
-            terminal_writestring(cmd->owner->name);
-            terminal_writestring("' is not loaded\n");
+            kprintf("Error: Extension '%s' is not loaded\n", cmd->owner->name);
         } else {
+            extension_t* saved_owner = heap_owner;
+            heap_owner = cmd->owner;
             cmd->handler(args);
+            heap_owner = saved_owner;
         }
     } else {
-        terminal_writestring("Unknown command: ");
-        terminal_writestring(command);
-        terminal_writestring("\nType 'help' for available commands.\n");
+        kprintf("Unknown command: %s\nType 'help' for available commands.\n", command);
     }
 
     terminal_writestring("\n");
 }
 
-void kernel_main(void) {
+void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
+    string_initialize();
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC) {
+        boot_info = mbi;
+    }
     terminal_initialize();
     memory_initialize();
 
@@ -418,6 +771,8 @@ void kernel_main(void) {
     terminal_writestring("Extensible kernel core initialized\n\n");
 
     initialize_all_extensions();
+    module_load_boot_modules();
+    irqsoff_initialize();
 
     terminal_writestring("Welcome to BASE kernel!\n");
     terminal_writestring("This is the minimal core. Extensions add functionality.\n");
@@ -432,11 +787,19 @@ void kernel_main(void) {
     terminal_writestring("Awaiting keyboard input via 'cli_test' or other extension commands.\n");
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
 
-    while (1) {
-        asm volatile("hlt");
-    }
+    process_command("cli_test");
+    async_run();
 }
 
-void _start(void) {
-    kernel_main();
+multiboot_info_t* get_boot_info(void) {
+    return boot_info;
 }
+
+asm(".global _start\n"
+    "_start:\n"
+    "    mov $boot_stack + " TOSTRING(BOOT_STACK_SIZE) ", %esp\n"
+    "    push %ebx\n"
+    "    push %eax\n"
+    "    call kernel_main\n"
+    "1:  hlt\n"
+    "    jmp 1b\n");
@@ -0,0 +1,240 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include "base_kernel.h"
+
+#define KPRINTF_BUFFER_SIZE 256
+
+#define FMT_LEFT 0x01
+#define FMT_ZERO 0x02
+#define FMT_UPPER 0x04
+#define FMT_SIGNED 0x08
+
+typedef struct fmt_out {
+    char* buf;
+    size_t size;
+    size_t pos;
+    size_t total;
+    int flush;
+} fmt_out_t;
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static void fmt_putc(fmt_out_t* out, char c) {
+    out->total++;
+
+    if (out->pos + 1 >= out->size) {
+        if (!out->flush) {
+            return;
+        }
+        terminal_write(out->buf, out->pos);
+        out->pos = 0;
+    }
+    out->buf[out->pos++] = c;
+}
+
+static void fmt_pad(fmt_out_t* out, char c, int count) {
+    while (count-- > 0) {
+        fmt_putc(out, c);
+    }
+}
+
+static void fmt_field(fmt_out_t* out, const char* str, int len, int width, int flags) {
+    int pad = width > len ? width - len : 0;
+
+    if (!(flags & FMT_LEFT)) {
+        fmt_pad(out, ' ', pad);
+    }
+    for (int i = 0; i < len; i++) {
+        fmt_putc(out, str[i]);
+    }
+    if (flags & FMT_LEFT) {
+        fmt_pad(out, ' ', pad);
+    }
+}
+
+static char* fmt_u32_dec(char* end, uint32_t value) {
+    while (value >= 100) {
+        uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        *--end = digit_pairs[value * 2 + 1];
+        *--end = digit_pairs[value * 2];
+    } else {
+        *--end = '0' + value;
+    }
+    return end;
+}
+
+static char* fmt_u64_dec(char* end, uint64_t value) {
+    while (value >> 32) {
+        uint32_t chunk = div64_u32(&value, 100000000);
+        char* stop = end - 8;
+        end = fmt_u32_dec(end, chunk);
+        while (end > stop) {
+            *--end = '0';
+        }
+    }
+    return fmt_u32_dec(end, (uint32_t)value);
+}
+
+static char* fmt_u64_hex(char* end, uint64_t value, int upper) {
+    const char* hex = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    do {
+        *--end = hex[value & 0xF];
+        value >>= 4;
+    } while (value);
+    return end;
+}
+
+static void fmt_number(fmt_out_t* out, uint64_t value, int negative, int hex,
+                       int width, int flags) {
+    char tmp[24];
+    char* end = tmp + sizeof(tmp);
+    char* start = hex ? fmt_u64_hex(end, value, flags & FMT_UPPER) : fmt_u64_dec(end, value);
+    int len = end - start;
+    int sign = negative ? 1 : 0;
+
+    if ((flags & FMT_ZERO) && !(flags & FMT_LEFT)) {
+        if (sign) {
+            fmt_putc(out, '-');
+        }
+        fmt_pad(out, '0', width - len - sign);
+        fmt_field(out, start, len, 0, flags);
+        return;
+    }
+
+    if (sign) {
+        *--start = '-';
+        len++;
+    }
+    fmt_field(out, start, len, width, flags);
+}
+
+static void fmt_engine(fmt_out_t* out, const char* fmt, va_list ap) {
+    while (*fmt) {
+        if (*fmt != '%') {
+            fmt_putc(out, *fmt++);
+            continue;
+        }
+        fmt++;
+
+        int flags = 0;
+        for (;; fmt++) {
+            if (*fmt == '-') flags |= FMT_LEFT;
+            else if (*fmt == '0') flags |= FMT_ZERO;
+            else break;
+        }
+
+        int width = 0;
+        while (*fmt >= '0' && *fmt <= '9') {
+            width = width * 10 + (*fmt++ - '0');
+        }
+
+        int longs = 0;
+        while (*fmt == 'l') {
+            longs++;
+            fmt++;
+        }
+
+        uint64_t value;
+        switch (*fmt) {
+        case 'd':
+        case 'i': {
+            int64_t sv = longs >= 2 ? va_arg(ap, int64_t) : (int64_t)va_arg(ap, long);
+            value = sv < 0 ? (uint64_t)-sv : (uint64_t)sv;
+            fmt_number(out, value, sv < 0, 0, width, flags);
+            break;
+        }
+        case 'u':
+            value = longs >= 2 ? va_arg(ap, uint64_t) : va_arg(ap, unsigned long);
+            fmt_number(out, value, 0, 0, width, flags);
+            break;
+        case 'X':
+            flags |= FMT_UPPER;
+            /* fall through */
+        case 'x':
+            value = longs >= 2 ? va_arg(ap, uint64_t) : va_arg(ap, unsigned long);
+            fmt_number(out, value, 0, 1, width, flags);
+            break;
+        case 'p':
+            fmt_putc(out, '0');
+            fmt_putc(out, 'x');
+            fmt_number(out, (uint32_t)va_arg(ap, void*), 0, 1, 8, FMT_ZERO);
+            break;
+        case 's': {
+            const char* str = va_arg(ap, const char*);
+            if (!str) {
+                str = "(null)";
+            }
+            fmt_field(out, str, strlen(str), width, flags);
+            break;
+        }
+        case 'c': {
+            char c = (char)va_arg(ap, int);
+            fmt_field(out, &c, 1, width, flags);
+            break;
+        }
+        case '%':
+            fmt_putc(out, '%');
+            break;
+        case '\0':
+            return;
+        default:
+            fmt_putc(out, '%');
+            fmt_putc(out, *fmt);
+            break;
+        }
+        fmt++;
+    }
+}
+
+int kvsnprintf(char* buf, size_t size, const char* fmt, va_list ap) {
+    fmt_out_t out = { buf, size, 0, 0, 0 };
+
+    fmt_engine(&out, fmt, ap);
+    if (size > 0) {
+        buf[out.pos] = '\0';
+    }
+    return out.total;
+}
+
+int ksnprintf(char* buf, size_t size, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int len = kvsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+int kvprintf(const char* fmt, va_list ap) {
+    char buf[KPRINTF_BUFFER_SIZE];
+    fmt_out_t out = { buf, sizeof(buf), 0, 0, 1 };
+
+    fmt_engine(&out, fmt, ap);
+    if (out.pos > 0) {
+        terminal_write(buf, out.pos);
+    }
+    return out.total;
+}
+
+int kprintf(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int len = kvprintf(fmt, ap);
+    va_end(ap);
+    return len;
+}
@@ -0,0 +1,388 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "base_kernel.h"
+#include "multiboot.h"
+#include "elf.h"
+
+#define MAX_MODULES 8
+#define MODULE_MAX_SECTIONS 64
+#define MODULE_MAX_SIZE 0x100000
+#define MODULE_REGISTER_SECTION ".ext_register_fns"
+
+typedef struct kernel_symbol {
+    const char* name;
+    void* addr;
+} kernel_symbol_t;
+
+typedef struct module {
+    char name[32];
+    void* base;
+    size_t size;
+    int first_ext;
+    int ext_count;
+    int loaded;
+} module_t;
+
+#define KSYM(sym) { #sym, (void*)sym }
+
+/* Everything a module may link against. Anything not listed here stays
+   private to the kernel image. */
+static const kernel_symbol_t kernel_symbols[] = {
+    KSYM(terminal_writestring), KSYM(terminal_write), KSYM(terminal_putchar),
+    KSYM(terminal_setcolor), KSYM(kprintf), KSYM(ksnprintf),
+    KSYM(kmalloc), KSYM(kfree),
+    KSYM(irqsoff_begin), KSYM(irqsoff_end),
+    KSYM(memcpy), KSYM(memmove), KSYM(memset), KSYM(memcmp),
+    KSYM(strlen), KSYM(strlcpy), KSYM(strcmp),
+    KSYM(register_extension), KSYM(load_extension), KSYM(unload_extension),
+    KSYM(register_command),
+    KSYM(register_timer_callback), KSYM(unregister_timer_callback),
+    KSYM(register_irq_handler), KSYM(unregister_irq_handler),
+    KSYM(register_syscall), KSYM(unregister_syscall),
+    KSYM(read_char_from_kb_buffer), KSYM(wait_for_char_from_kb_buffer),
+    KSYM(pci_find_device), KSYM(pci_config_read32), KSYM(pci_config_write32),
+    KSYM(pci_enable_bus_master),
+    KSYM(register_block_device), KSYM(unregister_block_device),
+    KSYM(find_block_device), KSYM(block_submit),
+    KSYM(block_unplug), KSYM(block_rw_start), KSYM(block_rw_sync),
+    KSYM(bcache_read), KSYM(bcache_release), KSYM(bcache_mark_dirty),
+    KSYM(async_spawn), KSYM(async_cancel), KSYM(timer_get_ticks),
+    KSYM(ipc_create), KSYM(ipc_destroy), KSYM(ipc_lookup), KSYM(ipc_set_receiver),
+    KSYM(ipc_page_alloc), KSYM(ipc_page_free), KSYM(ipc_send),
+    KSYM(ipc_commit), KSYM(ipc_recv),
+};
+
+static module_t modules[MAX_MODULES];
+static uint32_t section_base[MODULE_MAX_SECTIONS];
+
+static void* kernel_symbol_lookup(const char* name) {
+    for (size_t i = 0; i < sizeof(kernel_symbols) / sizeof(kernel_symbols[0]); i++) {
+        if (strcmp(kernel_symbols[i].name, name) == 0) {
+            return kernel_symbols[i].addr;
+        }
+    }
+    return NULL;
+}
+
+/* Offsets, sizes and indices all come from the file, so every section the
+   loader reads through is checked against the image before it is used. */
+static int module_section_ok(const Elf32_Shdr* sh, size_t size) {
+    return sh->sh_type == SHT_NOBITS ||
+           (sh->sh_offset <= size && sh->sh_size <= size - sh->sh_offset);
+}
+
+static int module_strtab_ok(const uint8_t* image, const Elf32_Shdr* sh, size_t size) {
+    return sh->sh_type != SHT_NOBITS && sh->sh_size > 0 && module_section_ok(sh, size) &&
+           image[sh->sh_offset + sh->sh_size - 1] == '\0';
+}
+
+static int module_validate(const uint8_t* image, size_t size, const Elf32_Shdr* shdrs,
+                           uint16_t shnum, uint16_t shstrndx) {
+    if (shstrndx == SHN_UNDEF || shstrndx >= shnum ||
+        !module_strtab_ok(image, &shdrs[shstrndx], size)) {
+        return -1;
+    }
+
+    for (uint16_t i = 0; i < shnum; i++) {
+        const Elf32_Shdr* sh = &shdrs[i];
+        uint32_t align = sh->sh_addralign;
+        if (!module_section_ok(sh, size) || sh->sh_name >= shdrs[shstrndx].sh_size ||
+            align > 4096 || (align & (align - 1))) {
+            return -1;
+        }
+        if (sh->sh_type == SHT_SYMTAB &&
+            (sh->sh_link >= shnum || !module_strtab_ok(image, &shdrs[sh->sh_link], size))) {
+            return -1;
+        }
+        if (sh->sh_type == SHT_REL &&
+            (sh->sh_link >= shnum || shdrs[sh->sh_link].sh_type != SHT_SYMTAB ||
+             sh->sh_info >= shnum)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int module_symbol_value(const char* mod_name, const Elf32_Sym* sym,
+                               const char* strtab, uint32_t strtab_size, uint32_t* value) {
+    switch (sym->st_shndx) {
+    case SHN_UNDEF: {
+        if (sym->st_name >= strtab_size) {
+            kprintf("Module %s: symbol name out of range\n", mod_name);
+            return -1;
+        }
+        const char* name = strtab + sym->st_name;
+        void* addr = kernel_symbol_lookup(name);
+        if (!addr && ELF32_ST_BIND(sym->st_info) != STB_WEAK) {
+            kprintf("Module %s: unresolved symbol '%s'\n", mod_name, name);
+            return -1;
+        }
+        *value = (uint32_t)addr;
+        return 0;
+    }
+    case SHN_ABS:
+        *value = sym->st_value;
+        return 0;
+    case SHN_COMMON:
+        kprintf("Module %s: common symbols unsupported (build with -fno-common)\n", mod_name);
+        return -1;
+    default:
+        if (sym->st_shndx >= MODULE_MAX_SECTIONS || !section_base[sym->st_shndx]) {
+            return -1;
+        }
+        *value = section_base[sym->st_shndx] + sym->st_value;
+        return 0;
+    }
+}
+
+static int module_relocate(const char* mod_name, const uint8_t* image,
+                           const Elf32_Shdr* shdrs, const Elf32_Shdr* rel_sec) {
+    const Elf32_Shdr* target = &shdrs[rel_sec->sh_info];
+    const Elf32_Shdr* symtab = &shdrs[rel_sec->sh_link];
+    const Elf32_Sym* syms = (const Elf32_Sym*)(image + symtab->sh_offset);
+    const char* strtab = (const char*)(image + shdrs[symtab->sh_link].sh_offset);
+    uint32_t strtab_size = shdrs[symtab->sh_link].sh_size;
+    uint32_t sym_count = symtab->sh_size / sizeof(Elf32_Sym);
+    const Elf32_Rel* rels = (const Elf32_Rel*)(image + rel_sec->sh_offset);
+    uint32_t count = rel_sec->sh_size / sizeof(Elf32_Rel);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t sym_index = ELF32_R_SYM(rels[i].r_info);
+        if (target->sh_size < 4 || rels[i].r_offset > target->sh_size - 4 ||
+            sym_index >= sym_count) {
+            kprintf("Module %s: relocation %u out of range\n", mod_name, i);
+            return -1;
+        }
+
+        uint32_t* where = (uint32_t*)(section_base[rel_sec->sh_info] + rels[i].r_offset);
+        uint32_t s;
+        if (module_symbol_value(mod_name, &syms[sym_index], strtab, strtab_size, &s) != 0) {
+            return -1;
+        }
+
+        switch (ELF32_R_TYPE(rels[i].r_info)) {
+        case R_386_NONE:
+            break;
+        case R_386_32:
+            *where += s;
+            break;
+        case R_386_PC32:
+        case R_386_PLT32:
+            *where += s - (uint32_t)where;
+            break;
+        default:
+            kprintf("Module %s: unsupported relocation type %u\n", mod_name,
+                    ELF32_R_TYPE(rels[i].r_info));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void module_run_registrations(const uint8_t* image, const Elf32_Shdr* shdrs,
+                                     uint16_t shnum, uint16_t reg_index) {
+    for (uint16_t i = 0; i < shnum; i++) {
+        if (shdrs[i].sh_type != SHT_SYMTAB) {
+            continue;
+        }
+
+        const Elf32_Sym* syms = (const Elf32_Sym*)(image + shdrs[i].sh_offset);
+        uint32_t count = shdrs[i].sh_size / sizeof(Elf32_Sym);
+        for (uint32_t j = 0; j < count; j++) {
+            if (syms[j].st_shndx == reg_index && ELF32_ST_TYPE(syms[j].st_info) == STT_FUNC &&
+                syms[j].st_value < shdrs[reg_index].sh_size) {
+                void (*fn)(void) = (void (*)(void))(section_base[reg_index] + syms[j].st_value);
+                fn();
+            }
+        }
+    }
+}
+
+int module_load(const char* name, const void* data, size_t size) {
+    const uint8_t* image = (const uint8_t*)data;
+    const Elf32_Ehdr* ehdr = (const Elf32_Ehdr*)image;
+
+    if (size < sizeof(Elf32_Ehdr) || ehdr->e_ident[0] != ELFMAG0 ||
+        ehdr->e_ident[1] != 'E' || ehdr->e_ident[2] != 'L' || ehdr->e_ident[3] != 'F' ||
+        ehdr->e_ident[4] != ELFCLASS32 || ehdr->e_ident[5] != ELFDATA2LSB ||
+        ehdr->e_type != ET_REL || ehdr->e_machine != EM_386 ||
+        ehdr->e_shentsize != sizeof(Elf32_Shdr) || ehdr->e_shnum > MODULE_MAX_SECTIONS ||
+        ehdr->e_shoff > size || ehdr->e_shnum * sizeof(Elf32_Shdr) > size - ehdr->e_shoff) {
+        kprintf("Module %s: not an i386 relocatable ELF object\n", name);
+        return -1;
+    }
+
+    const Elf32_Shdr* shdrs = (const Elf32_Shdr*)(image + ehdr->e_shoff);
+    uint16_t shnum = ehdr->e_shnum;
+    if (module_validate(image, size, shdrs, shnum, ehdr->e_shstrndx) != 0) {
+        kprintf("Module %s: malformed section headers\n", name);
+        return -1;
+    }
+
+    module_t* mod = NULL;
+    for (int i = 0; i < MAX_MODULES; i++) {
+        if (!modules[i].loaded) {
+            mod = &modules[i];
+            break;
+        }
+    }
+    if (!mod) {
+        return -1;
+    }
+
+    const char* shstrtab = (const char*)(image + shdrs[ehdr->e_shstrndx].sh_offset);
+    uint16_t reg_index = 0;
+
+    uint32_t total = 0;
+    memset(section_base, 0, sizeof(section_base));
+    for (uint16_t i = 0; i < shnum; i++) {
+        if (!(shdrs[i].sh_flags & SHF_ALLOC) || shdrs[i].sh_size == 0) {
+            continue;
+        }
+        uint32_t align = shdrs[i].sh_addralign ? shdrs[i].sh_addralign : 1;
+        total = (total + align - 1) & ~(align - 1);
+        if (shdrs[i].sh_size > MODULE_MAX_SIZE - total) {
+            kprintf("Module %s: too large\n", name);
+            return -1;
+        }
+        section_base[i] = total;
+        total += shdrs[i].sh_size;
+
+        if (strcmp(shstrtab + shdrs[i].sh_name, MODULE_REGISTER_SECTION) == 0) {
+            reg_index = i;
+        }
+    }
+
+    if (total == 0) {
+        kprintf("Module %s: no allocatable sections\n", name);
+        return -1;
+    }
+
+    uint8_t* base = (uint8_t*)kmalloc(total);
+    if (!base) {
+        kprintf("Module %s: out of memory (%u bytes)\n", name, total);
+        return -1;
+    }
+
+    for (uint16_t i = 0; i < shnum; i++) {
+        if (!(shdrs[i].sh_flags & SHF_ALLOC) || shdrs[i].sh_size == 0) {
+            continue;
+        }
+        section_base[i] += (uint32_t)base;
+        if (shdrs[i].sh_type == SHT_NOBITS) {
+            memset((void*)section_base[i], 0, shdrs[i].sh_size);
+        } else {
+            memcpy((void*)section_base[i], image + shdrs[i].sh_offset, shdrs[i].sh_size);
+        }
+    }
+
+    for (uint16_t i = 0; i < shnum; i++) {
+        if (shdrs[i].sh_type == SHT_RELA) {
+            kprintf("Module %s: RELA relocations unsupported on i386\n", name);
+            kfree(base);
+            return -1;
+        }
+        if (shdrs[i].sh_type != SHT_REL || shdrs[i].sh_info >= shnum ||
+            !section_base[shdrs[i].sh_info]) {
+            continue;
+        }
+        if (module_relocate(name, image, shdrs, &shdrs[i]) != 0) {
+            kfree(base);
+            return -1;
+        }
+    }
+
+    strlcpy(mod->name, name, sizeof(mod->name));
+    mod->base = base;
+    mod->size = total;
+    mod->first_ext = get_extension_count();
+    mod->loaded = 1;
+
+    if (reg_index) {
+        module_run_registrations(image, shdrs, shnum, reg_index);
+    }
+    mod->ext_count = get_extension_count() - mod->first_ext;
+
+    kprintf("Module %s: loaded at %p (%u bytes, %d extensions)\n", name, base,
+            total, mod->ext_count);
+    return 0;
+}
+
+int module_unload(const char* name) {
+    for (int i = 0; i < MAX_MODULES; i++) {
+        module_t* mod = &modules[i];
+        if (!mod->loaded || strcmp(mod->name, name) != 0) {
+            continue;
+        }
+
+        for (int e = 0; e < mod->ext_count; e++) {
+            unregister_extension(mod->first_ext + e);
+        }
+        kfree(mod->base);
+        mod->loaded = 0;
+        return 0;
+    }
+    return -1;
+}
+
+static const char* module_basename(const char* path) {
+    const char* base = path;
+    for (const char* p = path; *p && *p != ' '; p++) {
+        if (*p == '/') {
+            base = p + 1;
+        }
+    }
+    return base;
+}
+
+void module_load_boot_modules(void) {
+    multiboot_info_t* mbi = get_boot_info();
+    if (!mbi || !(mbi->flags & MULTIBOOT_INFO_MODS) || mbi->mods_count == 0) {
+        return;
+    }
+
+    multiboot_module_t* mods = (multiboot_module_t*)mbi->mods_addr;
+    for (uint32_t i = 0; i < mbi->mods_count; i++) {
+        char name[32];
+        const char* path = mods[i].cmdline ? (const char*)mods[i].cmdline : "module";
+        const char* base = module_basename(path);
+        size_t len = 0;
+        while (base[len] && base[len] != ' ' && len < sizeof(name) - 1) {
+            name[len] = base[len];
+            len++;
+        }
+        name[len] = '\0';
+
+        module_load(name, (const void*)mods[i].mod_start, mods[i].mod_end - mods[i].mod_start);
+    }
+}
+
+void cmd_lsmod(const char* args) {
+    terminal_writestring("Loaded Modules:\n");
+
+    int count = 0;
+    for (int i = 0; i < MAX_MODULES; i++) {
+        if (modules[i].loaded) {
+            kprintf("  %-16s %p %6u bytes  %d extensions\n", modules[i].name,
+                    modules[i].base, modules[i].size, modules[i].ext_count);
+            count++;
+        }
+    }
+
+    if (count == 0) {
+        terminal_writestring("  No modules loaded\n");
+    }
+}
+
+void cmd_rmmod(const char* args) {
+    if (!*args) {
+        terminal_writestring("Usage: rmmod <module>\n");
+        return;
+    }
+
+    if (module_unload(args) == 0) {
+        kprintf("Module %s unloaded\n", args);
+    } else {
+        kprintf("Module %s not loaded\n", args);
+    }
+}
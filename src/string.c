@@ -0,0 +1,280 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "base_kernel.h"
+
+#define CPUID_1_EDX_FXSR (1u << 24)
+#define CPUID_1_EDX_SSE2 (1u << 26)
+#define CPUID_7_EBX_ERMS (1u << 9)
+
+#define CR0_MP (1u << 1)
+#define CR0_EM (1u << 2)
+#define CR4_OSFXSR (1u << 9)
+#define CR4_OSXMMEXCPT (1u << 10)
+
+#define SSE2_COPY_THRESHOLD 512
+#define SSE2_IRQ_BATCH 64
+
+typedef uint32_t __attribute__((may_alias)) word_alias_t;
+
+static void* memcpy_rep(void* dst, const void* src, size_t n);
+static void* memset_rep(void* dst, int c, size_t n);
+
+static void* (*memcpy_impl)(void*, const void*, size_t) = memcpy_rep;
+static void* (*memset_impl)(void*, int, size_t) = memset_rep;
+static const char* string_impl_name = "rep movsd/stosd";
+
+static void* memcpy_rep(void* dst, const void* src, size_t n) {
+    void* d = dst;
+    size_t words = n >> 2;
+    size_t bytes = n & 3;
+    asm volatile("rep movsl\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep movsb"
+                 : "+D"(d), "+S"(src), "+c"(words)
+                 : "r"(bytes)
+                 : "memory");
+    return dst;
+}
+
+static void* memcpy_erms(void* dst, const void* src, size_t n) {
+    void* d = dst;
+    asm volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(n) : : "memory");
+    return dst;
+}
+
+/* No interrupt or exception stub saves the XMM registers, and handlers may
+   copy with SSE themselves. Each XMM value is therefore loaded and stored
+   within one asm statement, and each batch of 64-byte blocks runs with
+   interrupts off. */
+static void* memcpy_sse2(void* dst, const void* src, size_t n) {
+    if (n < SSE2_COPY_THRESHOLD) {
+        return memcpy_rep(dst, src, n);
+    }
+
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+
+    size_t head = (16 - ((uint32_t)d & 15)) & 15;
+    memcpy_rep(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    size_t blocks = n >> 6;
+    while (blocks) {
+        size_t batch = blocks < SSE2_IRQ_BATCH ? blocks : SSE2_IRQ_BATCH;
+        blocks -= batch;
+
+        uint32_t flags = local_irq_save();
+        while (batch--) {
+            asm volatile("movdqu 0(%1), %%xmm0\n\t"
+                         "movdqu 16(%1), %%xmm1\n\t"
+                         "movdqu 32(%1), %%xmm2\n\t"
+                         "movdqu 48(%1), %%xmm3\n\t"
+                         "movdqa %%xmm0, 0(%0)\n\t"
+                         "movdqa %%xmm1, 16(%0)\n\t"
+                         "movdqa %%xmm2, 32(%0)\n\t"
+                         "movdqa %%xmm3, 48(%0)"
+                         : : "r"(d), "r"(s) : "memory");
+            d += 64;
+            s += 64;
+        }
+        local_irq_restore(flags);
+    }
+
+    memcpy_rep(d, s, n & 63);
+    return dst;
+}
+
+static void* memset_rep(void* dst, int c, size_t n) {
+    void* d = dst;
+    uint32_t pattern = (uint8_t)c * 0x01010101u;
+    size_t words = n >> 2;
+    size_t bytes = n & 3;
+    asm volatile("rep stosl\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep stosb"
+                 : "+D"(d), "+c"(words)
+                 : "a"(pattern), "r"(bytes)
+                 : "memory");
+    return dst;
+}
+
+static void* memset_erms(void* dst, int c, size_t n) {
+    void* d = dst;
+    asm volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+    return dst;
+}
+
+static void* memset_sse2(void* dst, int c, size_t n) {
+    if (n < SSE2_COPY_THRESHOLD) {
+        return memset_rep(dst, c, n);
+    }
+
+    uint8_t* d = (uint8_t*)dst;
+    uint32_t pattern[4];
+    pattern[0] = pattern[1] = pattern[2] = pattern[3] = (uint8_t)c * 0x01010101u;
+
+    size_t head = (16 - ((uint32_t)d & 15)) & 15;
+    memset_rep(d, c, head);
+    d += head;
+    n -= head;
+
+    size_t blocks = n >> 6;
+    while (blocks) {
+        size_t batch = blocks < SSE2_IRQ_BATCH ? blocks : SSE2_IRQ_BATCH;
+        blocks -= batch;
+
+        uint32_t flags = local_irq_save();
+        while (batch--) {
+            asm volatile("movdqu (%1), %%xmm0\n\t"
+                         "movdqa %%xmm0, 0(%0)\n\t"
+                         "movdqa %%xmm0, 16(%0)\n\t"
+                         "movdqa %%xmm0, 32(%0)\n\t"
+                         "movdqa %%xmm0, 48(%0)"
+                         : : "r"(d), "r"(pattern) : "memory");
+            d += 64;
+        }
+        local_irq_restore(flags);
+    }
+
+    memset_rep(d, c, n & 63);
+    return dst;
+}
+
+void* memcpy(void* dst, const void* src, size_t n) {
+    return memcpy_impl(dst, src, n);
+}
+
+void* memset(void* dst, int c, size_t n) {
+    return memset_impl(dst, c, n);
+}
+
+void* memmove(void* dst, const void* src, size_t n) {
+    if ((uint32_t)dst - (uint32_t)src >= n) {
+        return memcpy_impl(dst, src, n);
+    }
+
+    uint8_t* d = (uint8_t*)dst + n - 1;
+    const uint8_t* s = (const uint8_t*)src + n - 1;
+    size_t bytes = n & 3;
+    size_t words = n >> 2;
+    asm volatile("std\n\t"
+                 "rep movsb\n\t"
+                 "sub $3, %%esi\n\t"
+                 "sub $3, %%edi\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep movsl\n\t"
+                 "cld"
+                 : "+D"(d), "+S"(s), "+c"(bytes)
+                 : "r"(words)
+                 : "memory", "cc");
+    return dst;
+}
+
+void memsetw(uint16_t* dst, uint16_t value, size_t count) {
+    asm volatile("rep stosw" : "+D"(dst), "+c"(count) : "a"(value) : "memory");
+}
+
+void memsetl(uint32_t* dst, uint32_t value, size_t count) {
+    asm volatile("rep stosl" : "+D"(dst), "+c"(count) : "a"(value) : "memory");
+}
+
+int memcmp(const void* a, const void* b, size_t n) {
+    const uint8_t* pa = (const uint8_t*)a;
+    const uint8_t* pb = (const uint8_t*)b;
+    for (size_t i = 0; i < n; i++) {
+        if (pa[i] != pb[i]) {
+            return pa[i] - pb[i];
+        }
+    }
+    return 0;
+}
+
+size_t strlen(const char* str) {
+    const char* p = str;
+
+    while ((uint32_t)p & 3) {
+        if (*p == '\0') {
+            return p - str;
+        }
+        p++;
+    }
+
+    const word_alias_t* w = (const word_alias_t*)p;
+    while (!((*w - 0x01010101u) & ~*w & 0x80808080u)) {
+        w++;
+    }
+
+    p = (const char*)w;
+    while (*p) {
+        p++;
+    }
+    return p - str;
+}
+
+size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+int strcmp(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return (uint8_t)*a - (uint8_t)*b;
+}
+
+static void enable_sse(void) {
+    uint32_t cr0, cr4;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 &= ~CR0_EM;
+    cr0 |= CR0_MP;
+    asm volatile("mov %0, %%cr0" : : "r"(cr0));
+
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    asm volatile("mov %0, %%cr4" : : "r"(cr4));
+}
+
+void string_initialize(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+    uint32_t max_leaf = eax;
+
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    uint32_t features = edx;
+
+    int erms = 0;
+    if (max_leaf >= 7) {
+        cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+        erms = (ebx & CPUID_7_EBX_ERMS) != 0;
+    }
+
+    int sse2 = (features & (CPUID_1_EDX_FXSR | CPUID_1_EDX_SSE2)) ==
+               (CPUID_1_EDX_FXSR | CPUID_1_EDX_SSE2);
+    if (sse2) {
+        enable_sse();
+    }
+
+    if (erms) {
+        memcpy_impl = memcpy_erms;
+        memset_impl = memset_erms;
+        string_impl_name = "rep movsb/stosb (ERMS)";
+    } else if (sse2) {
+        memcpy_impl = memcpy_sse2;
+        memset_impl = memset_sse2;
+        string_impl_name = "SSE2";
+    }
+}
+
+const char* string_impl(void) {
+    return string_impl_name;
+}
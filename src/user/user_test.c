@@ -0,0 +1,75 @@
+#include <stdint.h>
+#include "syscall.h"
+
+/* Everything the test program touches lives in the .user sections so the
+   linker groups it into one page-aligned image (_user_image_start/_end). */
+#define USER_TEXT __attribute__((section(".user_text")))
+#define USER_RODATA __attribute__((section(".user_rodata")))
+#define USER_DATA __attribute__((section(".user_data")))
+
+#define BENCH_ITERATIONS 1000
+
+static const char msg_banner[] USER_RODATA = "user_test: hello from ring 3\n";
+static const char msg_int80[] USER_RODATA = "user_test: int 0x80 round trip: ";
+static const char msg_sysenter[] USER_RODATA = "user_test: SYSENTER round trip: ";
+static const char msg_cycles[] USER_RODATA = " cycles\n";
+
+static int use_sysenter USER_DATA = 0;
+
+USER_TEXT static int sys(int num, int a1, int a2, int a3) {
+    if (use_sysenter) {
+        return syscall_sysenter(num, a1, a2, a3);
+    }
+    return syscall_int80(num, a1, a2, a3);
+}
+
+USER_TEXT static void put(const char* s, int len) {
+    sys(SYS_WRITE, (int)s, len, 0);
+}
+
+USER_TEXT static void put_uint(uint32_t v) {
+    char buf[10];
+    int i = sizeof(buf);
+    do {
+        buf[--i] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    put(buf + i, sizeof(buf) - i);
+}
+
+USER_TEXT static uint32_t rdtsc_low(void) {
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return low;
+}
+
+USER_TEXT static uint32_t bench(int sysenter) {
+    uint32_t start = rdtsc_low();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        if (sysenter) {
+            syscall_sysenter(SYS_NOP, 0, 0, 0);
+        } else {
+            syscall_int80(SYS_NOP, 0, 0, 0);
+        }
+    }
+    return (rdtsc_low() - start) / BENCH_ITERATIONS;
+}
+
+USER_TEXT void user_test_main(void) {
+    int have_sysenter = syscall_int80(SYS_HAS_SYSENTER, 0, 0, 0) == 1;
+
+    put(msg_banner, sizeof(msg_banner) - 1);
+
+    put(msg_int80, sizeof(msg_int80) - 1);
+    put_uint(bench(0));
+    put(msg_cycles, sizeof(msg_cycles) - 1);
+
+    if (have_sysenter) {
+        use_sysenter = 1;
+        put(msg_sysenter, sizeof(msg_sysenter) - 1);
+        put_uint(bench(1));
+        put(msg_cycles, sizeof(msg_cycles) - 1);
+    }
+
+    sys(SYS_EXIT, 0, 0, 0);
+}